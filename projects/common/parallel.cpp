@@ -0,0 +1,330 @@
+/*
+ * File: parallel.cpp
+ *
+ * Description:
+ *   Optimizes the functions of a module on a thread pool, see parallel.h
+ */
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/ValueMapper.h"
+
+#include "parallel.h"
+
+using namespace llvm;
+
+void renameInProgramOrder(Function &F) {
+  std::vector<std::pair<Value *, std::string>> Names;
+  auto Collect = [&](Value &V) {
+    if (V.hasName()) {
+      Names.push_back({&V, V.getName().str()});
+      V.setName("");
+    }
+  };
+  for (auto &Arg : F.args()) {
+    Collect(Arg);
+  }
+  for (auto &BB : F) {
+    Collect(BB);
+    for (auto &I : BB) {
+      Collect(I);
+    }
+  }
+  for (auto &Entry : Names) {
+    Entry.first->setName(Entry.second);
+  }
+}
+
+// Prefix given to the named struct types of a partition, so reading it back
+// cannot clash with the types already in the module's context.
+static std::string partitionTypePrefix(unsigned Partition) {
+  return "partition" + std::to_string(Partition) + ".";
+}
+
+// Maps the types of a partition read back into the module's context onto the
+// module's own types.
+class PartitionTypeRemapper : public ValueMapTypeRemapper {
+public:
+  PartitionTypeRemapper(LLVMContext &Context, std::string Prefix)
+      : Context(Context), Prefix(std::move(Prefix)) {}
+
+  Type *remapType(Type *Ty) override {
+    auto It = Mapped.find(Ty);
+    if (It != Mapped.end()) {
+      return It->second;
+    }
+
+    Type *Result = Ty;
+    if (auto *ST = dyn_cast<StructType>(Ty)) {
+      if (!ST->isLiteral()) {
+        StringRef Name = ST->getName();
+        if (Name.startswith(Prefix)) {
+          Result = StructType::getTypeByName(Context,
+                                             Name.drop_front(Prefix.size()));
+        }
+      } else {
+        SmallVector<Type *, 8> Elements;
+        for (Type *Element : ST->elements()) {
+          Elements.push_back(remapType(Element));
+        }
+        Result = StructType::get(Context, Elements, ST->isPacked());
+      }
+    } else if (auto *PT = dyn_cast<PointerType>(Ty)) {
+      if (!PT->isOpaque()) {
+        Result = PointerType::get(remapType(PT->getPointerElementType()),
+                                  PT->getAddressSpace());
+      }
+    } else if (auto *AT = dyn_cast<ArrayType>(Ty)) {
+      Result = ArrayType::get(remapType(AT->getElementType()),
+                              AT->getNumElements());
+    } else if (auto *VT = dyn_cast<VectorType>(Ty)) {
+      Result = VectorType::get(remapType(VT->getElementType()),
+                               VT->getElementCount());
+    } else if (auto *FT = dyn_cast<FunctionType>(Ty)) {
+      SmallVector<Type *, 8> Params;
+      for (Type *Param : FT->params()) {
+        Params.push_back(remapType(Param));
+      }
+      Result = FunctionType::get(
+          remapType(FT->getReturnType()), Params, FT->isVarArg());
+    }
+
+    if (!Result) {
+      report_fatal_error("partition type has no counterpart in the module");
+    }
+    Mapped[Ty] = Result;
+    return Result;
+  }
+
+private:
+  LLVMContext &Context;
+  std::string Prefix;
+  DenseMap<Type *, Type *> Mapped;
+};
+
+// Records that the partition's metadata node From is the module's node To,
+// and so are their operands. Compile units, subprograms and debug types the
+// workers never change then keep their identity instead of being duplicated.
+static void mapMetadata(MDNode *From, MDNode *To, ValueToValueMapTy &VMap) {
+  SmallVector<std::pair<MDNode *, MDNode *>, 32> Worklist;
+  Worklist.push_back({From, To});
+  while (!Worklist.empty()) {
+    MDNode *Src = Worklist.back().first;
+    MDNode *Dst = Worklist.back().second;
+    Worklist.pop_back();
+    if (Src->getMetadataID() != Dst->getMetadataID() ||
+        Src->getNumOperands() != Dst->getNumOperands()) {
+      continue;
+    }
+    TrackingMDRef &Entry = VMap.MD()[Src];
+    if (Entry) {
+      continue;
+    }
+    Entry.reset(Dst);
+    for (unsigned i = 0; i < Src->getNumOperands(); i++) {
+      auto *SrcOp = dyn_cast_or_null<MDNode>(Src->getOperand(i));
+      auto *DstOp = dyn_cast_or_null<MDNode>(Dst->getOperand(i));
+      if (SrcOp && DstOp) {
+        Worklist.push_back({SrcOp, DstOp});
+      }
+    }
+  }
+}
+
+// Loads a private copy of the module, optimizes the functions at the given
+// positions and returns the result as bitcode. Runs on a worker thread.
+static SmallVector<char, 0>
+optimizePartition(StringRef Bitcode,
+                  ArrayRef<unsigned> Assigned,
+                  unsigned Partition,
+                  function_ref<void(Function &)> Optimize) {
+  LLVMContext Context;
+  std::unique_ptr<Module> M = cantFail(
+      getLazyBitcodeModule(MemoryBufferRef(Bitcode, "partition"), Context));
+
+  std::vector<Function *> Functions;
+  for (auto &F : *M) {
+    Functions.push_back(&F);
+  }
+
+  // Bodies of other partitions are never loaded; they become declarations
+  std::vector<bool> Keep(Functions.size(), false);
+  for (unsigned Index : Assigned) {
+    Keep[Index] = true;
+  }
+  for (unsigned Index = 0; Index < Functions.size(); Index++) {
+    Function *F = Functions[Index];
+    if (!Keep[Index] && !F->isDeclaration()) {
+      F->deleteBody();
+      F->setComdat(nullptr);
+    }
+  }
+  cantFail(M->materializeAll());
+
+  for (unsigned Index : Assigned) {
+    Optimize(*Functions[Index]);
+  }
+
+  for (StructType *ST : M->getIdentifiedStructTypes()) {
+    ST->setName(partitionTypePrefix(Partition) + ST->getName().str());
+  }
+
+  SmallVector<char, 0> Result;
+  raw_svector_ostream OS(Result);
+  WriteBitcodeToFile(*M, OS);
+  return Result;
+}
+
+// Replaces the bodies of the functions at the given positions with the ones
+// optimized by a worker.
+static void mergePartition(Module &M,
+                           StringRef Bitcode,
+                           ArrayRef<unsigned> Assigned,
+                           unsigned Partition) {
+  std::unique_ptr<Module> Part = cantFail(
+      parseBitcodeFile(MemoryBufferRef(Bitcode, "partition"), M.getContext()));
+  if (Part->size() != M.size() || Part->global_size() != M.global_size() ||
+      Part->alias_size() != M.alias_size() ||
+      Part->ifunc_size() != M.ifunc_size() ||
+      Part->named_metadata_size() != M.named_metadata_size()) {
+    report_fatal_error("optimized partition does not match the module");
+  }
+
+  // Every global keeps its position through the round trip
+  ValueToValueMapTy VMap;
+  for (auto Pair : zip(Part->global_values(), M.global_values())) {
+    VMap[&std::get<0>(Pair)] = &std::get<1>(Pair);
+  }
+  for (auto Pair : zip(Part->named_metadata(), M.named_metadata())) {
+    NamedMDNode &Src = std::get<0>(Pair);
+    NamedMDNode &Dst = std::get<1>(Pair);
+    for (unsigned i = 0; i < Src.getNumOperands() && i < Dst.getNumOperands();
+         i++) {
+      mapMetadata(Src.getOperand(i), Dst.getOperand(i), VMap);
+    }
+  }
+  for (auto Pair : zip(Part->global_objects(), M.global_objects())) {
+    SmallVector<std::pair<unsigned, MDNode *>, 4> Attachments;
+    std::get<0>(Pair).getAllMetadata(Attachments);
+    for (auto &Attachment : Attachments) {
+      if (MDNode *Dst = std::get<1>(Pair).getMetadata(Attachment.first)) {
+        mapMetadata(Attachment.second, Dst, VMap);
+      }
+    }
+  }
+
+  std::vector<Function *> Sources;
+  std::vector<Function *> Targets;
+  for (auto Pair : zip(*Part, M)) {
+    Sources.push_back(&std::get<0>(Pair));
+    Targets.push_back(&std::get<1>(Pair));
+  }
+
+  PartitionTypeRemapper Types(M.getContext(), partitionTypePrefix(Partition));
+  for (unsigned Index : Assigned) {
+    Function *Src = Sources[Index];
+    Function *Dst = Targets[Index];
+    // The attributes may name types, so keep the module's own list
+    AttributeList Attrs = Dst->getAttributes();
+    Dst->dropAllReferences();
+    for (auto Args : zip(Src->args(), Dst->args())) {
+      VMap[&std::get<0>(Args)] = &std::get<1>(Args);
+    }
+    SmallVector<ReturnInst *, 8> Returns;
+    CloneFunctionInto(Dst,
+                      Src,
+                      VMap,
+                      CloneFunctionChangeType::ClonedModule,
+                      Returns,
+                      "",
+                      nullptr,
+                      &Types);
+    Dst->setAttributes(Attrs);
+    renameInProgramOrder(*Dst);
+  }
+}
+
+// Falls back to a serial loop for modules the partitions cannot be mapped
+// back onto: unnamed struct types and block addresses are not kept by name or
+// position.
+void optimizeFunctionsInParallel(Module &M,
+                                 unsigned Threads,
+                                 function_ref<void(Function &)> Optimize) {
+  bool CanSplit = true;
+  for (StructType *ST : M.getIdentifiedStructTypes()) {
+    CanSplit &= ST->hasName();
+  }
+  for (auto &F : M) {
+    for (auto &BB : F) {
+      CanSplit &= !BB.hasAddressTaken();
+    }
+  }
+  if (!CanSplit) {
+    for (auto &F : M) {
+      if (!F.isDeclaration()) {
+        Optimize(F);
+        renameInProgramOrder(F);
+      }
+    }
+    return;
+  }
+
+  // Deal the functions out largest first, each to the least loaded partition
+  std::vector<std::pair<unsigned, unsigned>> BySize;
+  unsigned Index = 0;
+  for (auto &F : M) {
+    if (!F.isDeclaration()) {
+      BySize.push_back({F.getInstructionCount(), Index});
+    }
+    Index++;
+  }
+  std::stable_sort(BySize.begin(),
+                   BySize.end(),
+                   [](const std::pair<unsigned, unsigned> &L,
+                      const std::pair<unsigned, unsigned> &R) {
+                     return L.first > R.first;
+                   });
+  unsigned NumPartitions = std::min<size_t>(Threads, BySize.size());
+  std::vector<std::vector<unsigned>> Partitions(NumPartitions);
+  std::vector<uint64_t> Load(NumPartitions, 0);
+  for (auto &Entry : BySize) {
+    unsigned Lightest =
+        std::min_element(Load.begin(), Load.end()) - Load.begin();
+    Partitions[Lightest].push_back(Entry.second);
+    Load[Lightest] += Entry.first + 1;
+  }
+
+  SmallVector<char, 0> Bitcode;
+  raw_svector_ostream OS(Bitcode);
+  WriteBitcodeToFile(M, OS);
+  StringRef Input(Bitcode.data(), Bitcode.size());
+
+  std::vector<SmallVector<char, 0>> Results(NumPartitions);
+  ThreadPool Pool(hardware_concurrency(NumPartitions));
+  for (unsigned P = 0; P < NumPartitions; P++) {
+    Pool.async([&, P] {
+      Results[P] = optimizePartition(Input, Partitions[P], P, Optimize);
+    });
+  }
+  Pool.wait();
+
+  for (unsigned P = 0; P < NumPartitions; P++) {
+    mergePartition(
+        M, StringRef(Results[P].data(), Results[P].size()), Partitions[P], P);
+  }
+}
+
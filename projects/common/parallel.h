@@ -0,0 +1,34 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+// Parallel driver shared by p2 and p3
+//
+// An LLVMContext must not be used from several threads, so functions cannot be
+// rewritten in place concurrently. Instead the module is written to bitcode
+// once and every worker loads a private copy into its own context, keeps only
+// the bodies it was assigned and optimizes those. The optimized bodies are
+// then read back and cloned over the originals, which leaves the module
+// exactly as the serial driver would. Statistics are atomic counters, so the
+// workers' increments add up to the serial totals.
+
+#include "llvm/ADT/STLFunctionalExtras.h"
+
+namespace llvm {
+class Function;
+class Module;
+} // namespace llvm
+
+// Runs Optimize on every function with a body, spread over Threads workers.
+// Optimize must only change the function it is given.
+void optimizeFunctionsInParallel(
+    llvm::Module &M,
+    unsigned Threads,
+    llvm::function_ref<void(llvm::Function &)> Optimize);
+
+// The bitcode writer emits a function's symbol table in hash table order,
+// which depends on the order its names were added. Re-adding every name in
+// program order after the function was optimized gives the same table
+// whether the body was rewritten in place or cloned from a worker's copy.
+void renameInProgramOrder(llvm::Function &F);
+
+#endif
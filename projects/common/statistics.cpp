@@ -0,0 +1,217 @@
+/*
+ * File: statistics.cpp
+ *
+ * Description:
+ *   Pass counters, phase timing and memory sampling, see statistics.h
+ */
+
+#include <algorithm>
+
+#include <sys/resource.h>
+
+#include "llvm/IR/Function.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/Process.h"
+
+#include "statistics.h"
+
+using namespace llvm;
+
+thread_local StatsRegistry::Record *StatsRegistry::Current = nullptr;
+
+unsigned StatsRegistry::slot(StringRef Name) {
+  auto Inserted = Slots.insert({Name, Names.size()});
+  if (Inserted.second) {
+    Names.push_back(Inserted.first->getKey());
+  }
+  return Inserted.first->getValue();
+}
+
+void StatsRegistry::add(Record R) {
+  std::lock_guard<std::mutex> Lock(RecordsLock);
+  Records.push_back(std::move(R));
+}
+
+std::vector<StatsRegistry::Record> StatsRegistry::records() {
+  std::lock_guard<std::mutex> Lock(RecordsLock);
+  std::vector<Record> Result = Records;
+  std::stable_sort(Result.begin(),
+                   Result.end(),
+                   [](const Record &L, const Record &R) {
+                     return L.Function < R.Function;
+                   });
+  return Result;
+}
+
+StatsScope::StatsScope(StringRef Pass, Function *F)
+    : F(F), Saved(StatsRegistry::Current),
+      Start(std::chrono::steady_clock::now()) {
+  R.Pass = Pass.str();
+  if (F) {
+    R.Function = F->getName().str();
+    R.InstructionsBefore = F->getInstructionCount();
+  }
+  StatsRegistry::Current = &R;
+}
+
+StatsScope::~StatsScope() {
+  R.Seconds =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - Start)
+          .count();
+  if (F) {
+    R.InstructionsAfter = F->getInstructionCount();
+  }
+  StatsRegistry::Current = Saved;
+  StatsRegistry::get().add(std::move(R));
+}
+
+// Largest resident set size of the process so far
+static uint64_t peakRSSSoFar() {
+  struct rusage Usage;
+  if (getrusage(RUSAGE_SELF, &Usage)) {
+    return 0;
+  }
+#ifdef __APPLE__
+  return Usage.ru_maxrss / 1024; // bytes
+#else
+  return Usage.ru_maxrss;
+#endif
+}
+
+PhaseReport::PhaseReport(bool Enabled, StringRef Tool)
+    : Enabled(Enabled), Group("phases", (Tool + " Phases").str()) {}
+
+void PhaseReport::start(StringRef Name, StringRef Description) {
+  finish();
+  if (Enabled) {
+    Timers.push_back(std::make_unique<Timer>(Name, Description, Group));
+    Timers.back()->startTimer();
+  }
+}
+
+void PhaseReport::finish() {
+  if (Timers.empty() || !Timers.back()->isRunning()) {
+    return;
+  }
+  Timer &T = *Timers.back();
+  T.stopTimer();
+  Phase P;
+  P.Name = T.getName();
+  P.Seconds = T.getTotalTime().getWallTime();
+  P.PeakRSSSoFar = peakRSSSoFar();
+  P.Heap = sys::Process::GetMallocUsage() / 1024;
+  Phases.push_back(P);
+}
+
+void PhaseReport::print(raw_ostream &OS) {
+  Group.print(OS, /*ResetAfterPrint=*/true);
+  OS << "Phase                Wall (s)   Peak RSS so far (KiB)   Heap (KiB)\n";
+  for (auto &P : Phases) {
+    OS << format("%-16s %12.4f %23llu %12llu\n",
+                 P.Name.c_str(),
+                 P.Seconds,
+                 (unsigned long long)P.PeakRSSSoFar,
+                 (unsigned long long)P.Heap);
+  }
+}
+
+void writeStatsJSON(raw_ostream &OS,
+                    function_ref<void(json::OStream &)> Run,
+                    const PhaseReport *Phases) {
+  StatsRegistry &Registry = StatsRegistry::get();
+  auto Counters = [&](json::OStream &J, ArrayRef<unsigned> Counts) {
+    J.attributeObject("counters", [&] {
+      for (unsigned Slot = 0; Slot < Counts.size(); Slot++) {
+        if (Counts[Slot]) {
+          J.attribute(Registry.names()[Slot], Counts[Slot]);
+        }
+      }
+    });
+  };
+
+  // A pass's counters are the sum of all its scopes'. Its time is that of its
+  // module level scopes, or of its functions when it has none.
+  std::vector<StatsRegistry::Record> Records = Registry.records();
+  std::vector<StatsRegistry::Record> Passes;
+  std::vector<double> FunctionSeconds;
+  std::vector<bool> Timed;
+  for (auto &R : Records) {
+    unsigned P = 0;
+    while (P < Passes.size() && Passes[P].Pass != R.Pass) {
+      P++;
+    }
+    if (P == Passes.size()) {
+      Passes.push_back(StatsRegistry::Record());
+      Passes[P].Pass = R.Pass;
+      FunctionSeconds.push_back(0);
+      Timed.push_back(false);
+    }
+    if (R.Function.empty()) {
+      Passes[P].Seconds += R.Seconds;
+      Timed[P] = true;
+    } else {
+      FunctionSeconds[P] += R.Seconds;
+    }
+    std::vector<unsigned> &Counts = Passes[P].Counts;
+    if (Counts.size() < R.Counts.size()) {
+      Counts.resize(R.Counts.size(), 0);
+    }
+    for (unsigned Slot = 0; Slot < R.Counts.size(); Slot++) {
+      Counts[Slot] += R.Counts[Slot];
+    }
+  }
+  for (unsigned P = 0; P < Passes.size(); P++) {
+    if (!Timed[P]) {
+      Passes[P].Seconds = FunctionSeconds[P];
+    }
+  }
+
+  json::OStream J(OS);
+  J.object([&] {
+    Run(J);
+    J.attributeObject("totals", [&] {
+      auto Totals = GetStatistics();
+      std::sort(Totals.begin(), Totals.end());
+      for (auto &Total : Totals) {
+        J.attribute(Total.first, Total.second);
+      }
+    });
+    J.attributeArray("passes", [&] {
+      for (auto &P : Passes) {
+        J.object([&] {
+          J.attribute("name", P.Pass);
+          J.attribute("seconds", P.Seconds);
+          Counters(J, P.Counts);
+        });
+      }
+    });
+    if (Phases && !Phases->phases().empty()) {
+      J.attributeArray("phases", [&] {
+        for (auto &P : Phases->phases()) {
+          J.object([&] {
+            J.attribute("name", P.Name);
+            J.attribute("seconds", P.Seconds);
+            J.attribute("peak_rss_so_far_kb", P.PeakRSSSoFar);
+            J.attribute("heap_kb", P.Heap);
+          });
+        }
+      });
+    }
+    J.attributeArray("functions", [&] {
+      for (auto &R : Records) {
+        if (R.Function.empty()) {
+          continue;
+        }
+        J.object([&] {
+          J.attribute("name", R.Function);
+          J.attribute("pass", R.Pass);
+          J.attribute("seconds", R.Seconds);
+          J.attribute("instructions_before", R.InstructionsBefore);
+          J.attribute("instructions_after", R.InstructionsAfter);
+          Counters(J, R.Counts);
+        });
+      }
+    });
+  });
+  OS << "\n";
+}
@@ -0,0 +1,153 @@
+#ifndef STATISTICS_H
+#define STATISTICS_H
+
+// Statistics shared by p2 (C and C++) and p3
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/STLFunctionalExtras.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/Timer.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace llvm {
+class Function;
+} // namespace llvm
+
+// Pass counters are StatsCounters: llvm::Statistics that also know their slot
+// in a per-scope record. While a StatsScope is open on a thread, the counters
+// bumped on that thread and the wall time spent are charged to it; a count
+// goes to the innermost open scope only, so a pass's counters add up to the
+// module totals whether or not it opens a scope per function. Module totals
+// still come from GetStatistics(), so the .stats file and -verbose are
+// unchanged; the per-pass and per-function breakdowns only appear in the JSON
+// record of the run.
+
+class StatsRegistry {
+public:
+  // What one StatsScope saw
+  struct Record {
+    std::string Pass;
+    std::string Function;
+    unsigned InstructionsBefore = 0;
+    unsigned InstructionsAfter = 0;
+    double Seconds = 0;
+    std::vector<unsigned> Counts;
+  };
+
+  static StatsRegistry &get() {
+    static StatsRegistry Registry;
+    return Registry;
+  }
+
+  // Slot of the counter called Name, assigned on first use
+  unsigned slot(llvm::StringRef Name);
+
+  llvm::ArrayRef<llvm::StringRef> names() const { return Names; }
+
+  void add(Record R);
+
+  // Records of functions sorted by name, and then in the order their passes
+  // ran; a function is only ever optimized on one thread
+  std::vector<Record> records();
+
+  static thread_local Record *Current;
+
+private:
+  llvm::StringMap<unsigned> Slots;
+  std::vector<llvm::StringRef> Names;
+  std::mutex RecordsLock;
+  std::vector<Record> Records;
+};
+
+class StatsCounter {
+public:
+  // Like llvm::Statistic, the strings must outlive the counter
+  StatsCounter(const char *DebugType, const char *Name, const char *Desc)
+      : Total(DebugType, Name, Desc), Slot(StatsRegistry::get().slot(Name)) {}
+
+  unsigned operator++(int) {
+    charge();
+    return Total++;
+  }
+  operator unsigned() const { return Total; }
+
+private:
+  void charge() {
+    if (StatsRegistry::Record *R = StatsRegistry::Current) {
+      if (R->Counts.size() <= Slot) {
+        R->Counts.resize(Slot + 1, 0);
+      }
+      R->Counts[Slot]++;
+    }
+  }
+
+  llvm::Statistic Total;
+  unsigned Slot;
+};
+
+// Charges the time until it goes out of scope, and the counters bumped
+// meanwhile outside any inner scope, to Pass and, if given, F
+class StatsScope {
+public:
+  StatsScope(llvm::StringRef Pass, llvm::Function *F = nullptr);
+  ~StatsScope();
+
+private:
+  llvm::Function *F;
+  StatsRegistry::Record R;
+  StatsRegistry::Record *Saved;
+  std::chrono::steady_clock::time_point Start;
+};
+
+// Phases of a tool's main: parsing, each pass, summarizing, verifying and
+// writing the output. With -time-report each phase runs under a Timer, and
+// when it ends the peak resident set size and the heap in use are sampled. A
+// phase lasts until the next one starts or finish() is called.
+class PhaseReport {
+public:
+  struct Phase {
+    std::string Name;
+    double Seconds = 0;
+    // The process's high-water mark when the phase ended, not the phase's
+    // own use: it never goes down, so a phase only shows up in it if it went
+    // past every phase before it
+    uint64_t PeakRSSSoFar = 0; // KiB
+    uint64_t Heap = 0;         // KiB
+  };
+
+  // Tool names the timer group, as in "p2 Phases"
+  PhaseReport(bool Enabled, llvm::StringRef Tool);
+
+  void start(llvm::StringRef Name, llvm::StringRef Description);
+  void finish();
+
+  llvm::ArrayRef<Phase> phases() const { return Phases; }
+
+  void print(llvm::raw_ostream &OS);
+
+private:
+  bool Enabled;
+  llvm::TimerGroup Group;
+  std::vector<std::unique_ptr<llvm::Timer>> Timers;
+  std::vector<Phase> Phases;
+};
+
+// Writes the statistics of the run as one line of JSON, so the records of
+// many runs can be concatenated and read back by wolfbench/jsonstats.py:
+// what Run adds to the top level object, then the module totals, the
+// breakdown per pass, the phases if there are any and the breakdown per
+// function
+void writeStatsJSON(llvm::raw_ostream &OS,
+                    llvm::function_ref<void(llvm::json::OStream &)> Run,
+                    const PhaseReport *Phases = nullptr);
+
+#endif
@@ -2,6 +2,9 @@
 #include <unistd.h>
 #include <memory>
 #include <algorithm>
+#include <atomic>
+#include <map>
+#include <vector>
 
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Value.h"
@@ -14,42 +17,131 @@
 #include "llvm/Support/ToolOutputFile.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/ThreadPool.h"
 
 using namespace llvm;
 using namespace std;
 
 
-unique_ptr<Module> parseP1File(const string &InputFilename);
+bool parseP1File(const string &InputFilename, Module &M, bool Batch);
+
+// Write M to OutputFilename as bitcode
+static bool writeModule(Module &M, const string &OutputFilename)
+{
+  std::error_code EC;
+  ToolOutputFile Out(OutputFilename, EC, sys::fs::OF_None);
+  if (EC) {
+    errs() << OutputFilename << ": " << EC.message() << "\n";
+    return false;
+  }
+  WriteBitcodeToFile(M, Out.os());
+  Out.keep();
+  return true;
+}
+
+// Compile each input on its own context, Threads at a time, into
+// OutputDir/<name>.bc
+static bool compileSeparately(const vector<string> &Inputs,
+                              const string &OutputDir, unsigned Threads,
+                              bool Batch)
+{
+  std::error_code EC = sys::fs::create_directories(OutputDir);
+  if (EC) {
+    errs() << OutputDir << ": " << EC.message() << "\n";
+    return false;
+  }
+
+  atomic<bool> ok(true);
+  ThreadPool Pool(hardware_concurrency(Threads));
+  for (const string &InputFilename : Inputs) {
+    Pool.async([&, InputFilename] {
+      LLVMContext Context;
+      string Name = sys::path::stem(InputFilename).str();
+      Module M(Name, Context);
+      SmallString<128> OutputFilename(OutputDir);
+      sys::path::append(OutputFilename, Name + ".bc");
+      if (!parseP1File(InputFilename, M, Batch) ||
+          !writeModule(M, OutputFilename.str().str())) {
+        printf("Errors in %s. No module produced.\n", InputFilename.c_str());
+        ok = false;
+      }
+    });
+  }
+  Pool.wait();
+  return ok;
+}
 
 int
 main (int argc, char ** argv)
 {
-  if (argc < 3) {
-    fprintf(stdout,"Usage: %s filein.p1 fileout.bc\n",argv[0]);
+  // -j N compiles the inputs in parallel, one module per input, and
+  // -batch adds each program's batch entry point
+  unsigned Threads = 0;
+  bool Batch = false;
+  int first = 1;
+  while (first < argc) {
+    if (argc - first > 1 && string(argv[first]) == "-j") {
+      Threads = max(1, atoi(argv[first + 1]));
+      first += 2;
+    } else if (string(argv[first]) == "-batch") {
+      Batch = true;
+      first++;
+    } else {
+      break;
+    }
+  }
+
+  if (argc - first < 2) {
+    fprintf(stdout,"Usage: %s [-batch] filein.p1... fileout.bc\n",argv[0]);
+    fprintf(stdout,"       %s [-batch] -j threads filein.p1... outdir\n",argv[0]);
     return 0;
   }
 
   // Remember command line strings
-  std::string InputFilename(argv[1]);
-  std::string OutputFilename(argv[2]);
+  std::vector<std::string> Inputs(argv + first, argv + argc - 1);
+  std::string OutputFilename(argv[argc - 1]);
 
-  // Make an output file
-  std::unique_ptr<ToolOutputFile> Out;  
-  std::string ErrorInfo;
-  std::error_code EC;
-  Out.reset(new ToolOutputFile(OutputFilename.c_str(), EC,
-			       sys::fs::OF_None));
+  // Functions, and with -j output files, are named after their inputs, so
+  // no two inputs may share a name. In one module a batch entry point takes
+  // a name too.
+  map<string, string> Names;
+  for (const std::string &InputFilename : Inputs) {
+    string Name = sys::path::stem(InputFilename).str();
+    vector<string> Taken = {Name};
+    if (Batch && Threads == 0)
+      Taken.push_back(Name + "_batch");
+    for (const string &N : Taken) {
+      auto Inserted = Names.insert({N, InputFilename});
+      if (!Inserted.second) {
+        errs() << argv[0] << ": " << Inserted.first->second << " and "
+               << InputFilename << " would both define " << N << "\n";
+        return 1;
+      }
+    }
+  }
+
+  if (Threads > 0)
+    return compileSeparately(Inputs, OutputFilename, Threads, Batch) ? 0 : 1;
 
-  // Do the work
-  unique_ptr<Module> M = parseP1File(InputFilename);
+  // Do the work: every input becomes a function of one module
+  LLVMContext Context;
+  StringRef Name = sys::path::stem(Inputs.size() == 1 ? Inputs[0] : OutputFilename);
+  unique_ptr<Module> M(new Module(Name, Context));
+  bool ok = true;
+  for (const std::string &InputFilename : Inputs)
+    ok = parseP1File(InputFilename, *M.get(), Batch) && ok;
 
   // If successful, produce LLVM bitcode
-  if (M.get() != nullptr) // if we get a valid module back
+  if (ok) // if we get a valid module back
     {
+      // Dump LLVM IR to the screen for debugging
+      if (Inputs.size() == 1)
+        M->print(errs(),nullptr,false,true);
+
       // Write the bitcode file out.
-      WriteBitcodeToFile(*M.get(),Out->os());    
-      // Keep the output file.
-      Out->keep();
+      if (!writeModule(*M.get(), OutputFilename))
+        return 1;
     }
   else
     {
@@ -59,4 +151,3 @@ main (int argc, char ** argv)
   
   return 0;
 }
-
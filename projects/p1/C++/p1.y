@@ -22,23 +22,17 @@
 #include "llvm/Support/SystemUtils.h"
 #include "llvm/Support/ToolOutputFile.h"
 #include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/PatternMatch.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/Transforms/Utils/Local.h"
+#include "llvm/Transforms/Utils/Cloning.h"
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
 
 using namespace llvm;
+using namespace llvm::PatternMatch;
 using namespace std;
 
-// Need for parser and scanner
-extern FILE *yyin;
-int yylex();
-void yyerror(const char*);
-int yyparse();
- 
-// Needed for LLVM
-string funName;
-Module *M;
-LLVMContext TheContext;
-IRBuilder<> Builder(TheContext);
-
 // ## DEBUGGING
 void debug(Value* val, string message) {
   val->print(errs(), true);
@@ -59,131 +53,474 @@ struct ValueSlice {
   Slice slice;
 };
 
-// ## GLOBAL VARIABLES
+// Every p1 value is a 32-bit word; narrower values are carried in fewer bits
+const unsigned MaxWidth = 32;
 
-// The values variable Dictionary. It holds the value of variables.
+// ## PARSER
 //
-// Slices are used only when doing bitwise_lhs operation.
-// In bitwise_lhs grammar, set the slice
-// In bitwise_lhs ASSIGN expr phase, reset the slice to be the whole range
-unordered_map <string, ValueSlice> valueSliceDict;
-
-// The slices variables Dictionary
-// A Dictionary that holds Slice as value and string as keys
-unordered_map <string, Slice> slicesDict;
-
-// BitsliceField IDs Helper
-vector<string> bitsliceFieldIds;
-
-// Tracking {a,b,c}
-bool bitsliceIsID = false;
-// ## FUNCTIONS / HELPERS
-
-// Bitslice range
-Value* bitsliceRange = Builder.getInt32(1);
-
-// Methods for SlicesDict
-
-// Add Slice to the slicesDict dictionary
-void addSlice(string key, Slice slice) {
-  slicesDict.insert(pair<string, Slice>(key, slice));
-}
-
-// Methods for ValueSliceDict 
-
-// Add a value and slice to the ValueSlice dictionary
-//
-// Input: String, Value*, Value*, Value*
-void addValueSlice(string name, Value* value, Value* start, Value* range) {
-  ValueSlice vs;
-  vs.value = value;
-  Slice s;
-  s.start = start;
-  s.range = range;
-  vs.slice = s;
-  // Insert vs into valueSliceDict
-  valueSliceDict.insert(make_pair(name, vs));
-}
-
-// Add a value to the ValueSlice dictionary (Overloaded)
-// 
-// Input: String, Value*, Value*
-void addValueSlice(string name, Value* value, Slice slice) {
-  ValueSlice vs;
-  vs.value = value;
-  vs.slice = slice;
-  // Insert vs into valueSliceDict
-  valueSliceDict.insert(make_pair(name, vs));
-}
-
-Slice defaultSlice() {
-  Slice s;
-  s.start = Builder.getInt32(0);
-  s.range = Builder.getInt32(32);
-  return s;
-}
-
-void addNewValue(string name, Value* value) {
-  ValueSlice vs;
-  vs.value = value;
-  vs.slice = defaultSlice();
-  valueSliceDict[name] = vs;
-}
-
-// Bit manipulation instructions
-
-// Create a function to retrive a bit from llvm builder value
-Value* getBit(Value* value, Value* position) {
-  return Builder.CreateAnd(Builder.CreateLShr(value, position), Builder.getInt32(1));
-}
-
-// Create a function to retrive a bit from llvm builder value
-Value* getBit(Value* value, int position) {
-  return Builder.CreateAnd(Builder.CreateLShr(value, position), Builder.getInt32(1));
-}
-
-// Get lowest bit from integer
-Value* getLowestBit(Value* value) {
-  return Builder.CreateAnd(value, Builder.getInt32(1));
-}
-
-Value* do_leftshiftbyn_add(Value* value, Value* shift, Value* add) {
-  return Builder.CreateAdd(Builder.CreateShl(value, shift), add);
-}
-
-Value* do_leftshiftbyn_add(Value* value, int shift, Value* add) {
-  // Left shift $1 by 1, add $3 to it
-  return do_leftshiftbyn_add(value, Builder.getInt32(shift), add);
-}
-
-Value* createMask(Value* start, Value* range) {
-  // Make all bits 1 from start to (start + range)
-  // N = 32
-  // For a[4]:8, start = 8, range = 4
-  // 0000 1111 0000 0000 <- Output
-  // 0000 0000 0000 0001 <- start = 0, range = 1
-
-  // 1. 1111 1111 1111 1111
-  Value* stepOne = Builder.getInt32(0xFFFFFFFF);
-
-  // 2. 0000 0000 0000 1111
-  // stepOne >> (N - range) = 12
-  Value* stepTwo = Builder.CreateLShr(stepOne, Builder.CreateSub(Builder.getInt32(32), range));
-
-  // 3. 0000 1111 0000 0000
-  // stepTwo << start
-  Value* mask = Builder.CreateShl(stepTwo, start);  
-  return mask;
-}
-
-Value* getMaskedValue(Value* value, Slice slice) {
-  // Input: slice(start, range), value
-  Value* mask = createMask(slice.start, slice.range);
-  // Output: value && MASK, right shift range or (range-1)
-  Value* valueAndMask = Builder.CreateAnd(mask, value);
-  Value* valueAligned = Builder.CreateLShr(valueAndMask, slice.start);
-  return valueAligned;
-}
+// Everything one compilation needs. Each file is parsed with its own
+// P1Parser, so several can go one after another into a shared module, or
+// side by side into modules on separate contexts.
+class P1Parser {
+public:
+  P1Parser(Module* M, const string &funName, bool batch)
+    : funName(funName), M(M), Builder(M->getContext()), batch(batch) {}
+
+  // Needed for LLVM
+  string funName;
+  Module* M;
+  IRBuilder<> Builder;
+
+  // Also emit funName_batch, see emitBatchFunction
+  bool batch;
+
+  // The function being built, removed again if the parse fails
+  Function* F = nullptr;
+
+  // ## STATE
+
+  // The values variable Dictionary. It holds the value of variables.
+  //
+  // Slices are used only when doing bitwise_lhs operation.
+  // In bitwise_lhs grammar, set the slice
+  // In bitwise_lhs ASSIGN expr phase, reset the slice to be the whole range
+  unordered_map <string, ValueSlice> valueSliceDict;
+
+  // The slices variables Dictionary
+  // A Dictionary that holds Slice as value and string as keys
+  unordered_map <string, Slice> slicesDict;
+
+  // BitsliceField IDs Helper
+  vector<string> bitsliceFieldIds;
+
+  // Tracking {a,b,c}
+  bool bitsliceIsID = false;
+
+  // Values that are a known slice of another value, by the value they came
+  // from. Lets adjacent slices in {...} merge into one slice of their source.
+  unordered_map <Value*, ValueSlice> sliceOrigin;
+
+  // ## FUNCTIONS / HELPERS
+
+  // Bitslice range
+  Value* bitsliceRange = Builder.getInt32(1);
+
+  // Methods for SlicesDict
+
+  // Add Slice to the slicesDict dictionary
+  void addSlice(string key, Slice slice) {
+    slicesDict.insert(pair<string, Slice>(key, slice));
+  }
+
+  // Methods for ValueSliceDict 
+
+  // Add a value and slice to the ValueSlice dictionary
+  //
+  // Input: String, Value*, Value*, Value*
+  void addValueSlice(string name, Value* value, Value* start, Value* range) {
+    ValueSlice vs;
+    vs.value = value;
+    Slice s;
+    s.start = start;
+    s.range = range;
+    vs.slice = s;
+    // Insert vs into valueSliceDict
+    valueSliceDict.insert(make_pair(name, vs));
+  }
+
+  // Add a value to the ValueSlice dictionary (Overloaded)
+  // 
+  // Input: String, Value*, Value*
+  void addValueSlice(string name, Value* value, Slice slice) {
+    ValueSlice vs;
+    vs.value = value;
+    vs.slice = slice;
+    // Insert vs into valueSliceDict
+    valueSliceDict.insert(make_pair(name, vs));
+  }
+
+  Slice defaultSlice() {
+    Slice s;
+    s.start = Builder.getInt32(0);
+    s.range = Builder.getInt32(32);
+    return s;
+  }
+
+  void addNewValue(string name, Value* value) {
+    ValueSlice vs;
+    vs.value = value;
+    vs.slice = defaultSlice();
+    valueSliceDict[name] = vs;
+  }
+
+  // Bit manipulation instructions
+  //
+  // A p1 value is a 32-bit word, and every operator wraps at bit 32 as it
+  // always has. A value whose upper bits are known to be zero may be carried
+  // as a narrower iN standing for its zero extension: a bit is i1, a
+  // constant slice [w]:s is iw and a literal uses as few bits as hold it.
+  // Operators give the same 32 bits whatever width their operands are
+  // carried at: and, or, xor and concatenation work at the wider of their
+  // operands' widths, up to 32, and everything else on i32. The function
+  // takes and returns i32.
+  //
+  // Slices whose start and range are literals arrive here as ConstantInts.
+  // For those the masks are computed now and only the shifts, truncs and
+  // ands that change some bit are emitted; expression indices get the
+  // general sequence on i32.
+
+  unsigned widthOf(Value* value) {
+    return value->getType()->getIntegerBitWidth();
+  }
+
+  // Zero extend or truncate value to width bits
+  Value* resize(Value* value, unsigned width) {
+    return Builder.CreateZExtOrTrunc(value, Builder.getIntNTy(width));
+  }
+
+  Value* toInt32(Value* value) {
+    return resize(value, 32);
+  }
+
+  // A literal in as few bits as hold it
+  Value* getConstant(uint32_t number) {
+    unsigned width = max(1u, (unsigned)APInt(32, number).getActiveBits());
+    return Builder.getIntN(width, number);
+  }
+
+  // Bring a and b to the wider of their widths, for and, or and xor
+  void sameWidth(Value* &a, Value* &b) {
+    unsigned width = max(widthOf(a), widthOf(b));
+    a = resize(a, width);
+    b = resize(b, width);
+  }
+
+  // Read a slice as {start, width} if both are known at compile time
+  bool getConstantSlice(Slice slice, unsigned &start, unsigned &width) {
+    ConstantInt* s = dyn_cast<ConstantInt>(slice.start);
+    ConstantInt* r = dyn_cast<ConstantInt>(slice.range);
+    if (s == nullptr || r == nullptr)
+      return false;
+    start = s->getZExtValue();
+    width = r->getZExtValue();
+    return true;
+  }
+
+  // The mask of width bits from start in a bits wide value
+  APInt constantMask(unsigned bits, unsigned start, unsigned width) {
+    if (start >= bits || width == 0)
+      return APInt::getZero(bits);
+    return APInt::getBitsSet(bits, start, min(bits, start + width));
+  }
+
+  // value & mask, left out when no bit of value outside mask can be set
+  Value* andMask(Value* value, const APInt &mask) {
+    if (mask.isZero())
+      return ConstantInt::get(value->getType(), 0);
+    if (mask.isAllOnes() ||
+        MaskedValueIsZero(value, ~mask, M->getDataLayout()))
+      return value;
+    return Builder.CreateAnd(value, mask);
+  }
+
+  Value* shiftLeft(Value* value, unsigned shift) {
+    if (shift >= widthOf(value))
+      return ConstantInt::get(value->getType(), 0);
+    return shift == 0 ? value : Builder.CreateShl(value, shift);
+  }
+
+  Value* shiftRight(Value* value, unsigned shift) {
+    if (shift >= widthOf(value))
+      return ConstantInt::get(value->getType(), 0);
+    return shift == 0 ? value : Builder.CreateLShr(value, shift);
+  }
+
+  // Remember that result holds bits start..start+width of value
+  void recordOrigin(Value* result, Value* value, unsigned start, unsigned width) {
+    if (result != value && !isa<Constant>(result))
+      sliceOrigin[result] = ValueSlice{value, Slice{Builder.getInt32(start), Builder.getInt32(width)}};
+  }
+
+  // A slice of a slice is a slice of the original value, which saves
+  // masking twice. False if the slice lies outside the bits value holds.
+  bool sliceOfOrigin(Value* &value, unsigned &start, unsigned &width) {
+    if (sliceOrigin.find(value) == sliceOrigin.end())
+      return true;
+    ValueSlice outer = sliceOrigin[value];
+    unsigned outerStart, outerWidth;
+    getConstantSlice(outer.slice, outerStart, outerWidth);
+    if (start >= outerWidth)
+      return false;
+    value = outer.value;
+    width = min(width, outerWidth - start);
+    start += outerStart;
+    return true;
+  }
+
+  // a | b for values known to have no bits in common
+  Value* combineBits(Value* a, Value* b) {
+    sameWidth(a, b);
+    if (match(a, m_Zero()))
+      return b;
+    if (match(b, m_Zero()))
+      return a;
+    return Builder.CreateOr(a, b);
+  }
+
+  Value* createMask(Value* start, Value* range) {
+    // Make all bits 1 from start to (start + range)
+    // N = 32
+    // For a[4]:8, start = 8, range = 4
+    // 0000 1111 0000 0000 <- Output
+    // 0000 0000 0000 0001 <- start = 0, range = 1
+    unsigned s, w;
+    if (getConstantSlice(Slice{start, range}, s, w))
+      return Builder.getInt(constantMask(32, s, w));
+
+    // 1. 1111 1111 1111 1111
+    Value* stepOne = Builder.getInt32(0xFFFFFFFF);
+
+    // 2. 0000 0000 0000 1111
+    // stepOne >> (N - range) = 12
+    Value* stepTwo = Builder.CreateLShr(stepOne, Builder.CreateSub(Builder.getInt32(32), range));
+
+    // 3. 0000 1111 0000 0000
+    // stepTwo << start
+    Value* mask = Builder.CreateShl(stepTwo, start);  
+    return mask;
+  }
+
+  Value* getMaskedValue(Value* value, Slice slice) {
+    // Known slice: the width bits at start, as an iN of that width
+    unsigned start, width;
+    if (getConstantSlice(slice, start, width)) {
+      if (width == 0 || !sliceOfOrigin(value, start, width) ||
+          start >= widthOf(value))
+        return Builder.getInt1(false);
+      width = min(width, widthOf(value) - start);
+      Value* bits = resize(shiftRight(value, start), width);
+      recordOrigin(bits, value, start, width);
+      return bits;
+    }
+
+    // Input: slice(start, range), value
+    value = toInt32(value);
+    Value* mask = createMask(slice.start, slice.range);
+    // Output: value && MASK, right shift range or (range-1)
+    Value* valueAndMask = Builder.CreateAnd(mask, value);
+    Value* valueAligned = Builder.CreateLShr(valueAndMask, slice.start);
+    return valueAligned;
+  }
+
+  // Create a function to retrive a bit from llvm builder value
+  Value* getBit(Value* value, int position) {
+    return getMaskedValue(value, Slice{Builder.getInt32(position), Builder.getInt32(1)});
+  }
+
+  // Create a function to retrive a bit from llvm builder value
+  Value* getBit(Value* value, Value* position) {
+    if (ConstantInt* c = dyn_cast<ConstantInt>(position))
+      return getBit(value, (int)c->getZExtValue());
+    value = toInt32(value);
+    return Builder.CreateAnd(Builder.CreateLShr(value, position), Builder.getInt32(1));
+  }
+
+  // Get lowest bit from integer
+  Value* getLowestBit(Value* value) {
+    return getBit(value, 0);
+  }
+
+  Value* do_leftshiftbyn_add(Value* value, Value* shift, Value* add) {
+    ConstantInt* c = dyn_cast<ConstantInt>(shift);
+    if (c == nullptr)
+      return Builder.CreateAdd(Builder.CreateShl(toInt32(value), shift), toInt32(add));
+    unsigned n = c->getZExtValue();
+
+    // {x3,x2}: x3 << 1 | x2 is the slice x[2]:2
+    if (sliceOrigin.find(value) != sliceOrigin.end() &&
+        sliceOrigin.find(add) != sliceOrigin.end()) {
+      ValueSlice high = sliceOrigin[value];
+      ValueSlice low = sliceOrigin[add];
+      unsigned highStart, highWidth, lowStart, lowWidth;
+      getConstantSlice(high.slice, highStart, highWidth);
+      getConstantSlice(low.slice, lowStart, lowWidth);
+      if (high.value == low.value && lowWidth == n &&
+          lowStart + lowWidth == highStart) {
+        Slice merged = Slice{low.slice.start, Builder.getInt32(lowWidth + highWidth)};
+        return getMaskedValue(low.value, merged);
+      }
+    }
+
+    // add fits below the shift, so adding is the same as or-ing it in, and
+    // the result is as wide as both together
+    if (n < MaxWidth &&
+        (widthOf(add) <= n ||
+         MaskedValueIsZero(add, ~constantMask(widthOf(add), 0, n),
+                           M->getDataLayout()))) {
+      unsigned width = min(MaxWidth, max(widthOf(value) + n, widthOf(add)));
+      return combineBits(shiftLeft(resize(value, width), n), resize(add, min(n, widthOf(add))));
+    }
+
+    Value* shifted = shiftLeft(toInt32(value), n);
+    if (match(add, m_Zero()))
+      return shifted;
+    return Builder.CreateAdd(shifted, toInt32(add));
+  }
+
+  Value* do_leftshiftbyn_add(Value* value, int shift, Value* add) {
+    // Left shift $1 by 1, add $3 to it
+    return do_leftshiftbyn_add(value, Builder.getInt32(shift), add);
+  }
+
+  // Replace the bits of value under slice with the low bits of expr
+  Value* setMaskedValue(Value* value, Slice slice, Value* expr) {
+    unsigned start, width;
+    if (getConstantSlice(slice, start, width)) {
+      // An empty slice writes nothing
+      if (width == 0)
+        return value;
+
+      // The slice covers all of value: value is now expr
+      if (start == 0 && width >= widthOf(value))
+        return resize(expr, min(widthOf(expr), width));
+
+      // value grows to hold the slice if need be
+      unsigned bits = min(MaxWidth, max(widthOf(value), start + width));
+      Value* part = resize(expr, min(widthOf(expr), width));
+      Value* maskedExpr = shiftLeft(resize(part, bits), start);
+      Value* safeValue = andMask(resize(value, bits), ~constantMask(bits, start, width));
+      return combineBits(maskedExpr, safeValue);
+    }
+
+    value = toInt32(value);
+    expr = toInt32(expr);
+
+    // 1. Mask = 0000 0000 1111 0000
+    // Get mask using slice of valueSlice
+    Value* mask = createMask(slice.start, slice.range);
+
+    // 2. expr = inputExpr << slice.start = xxxx xxxx 1001 xxxx
+    Value* shifted = Builder.CreateShl(expr, slice.start);
+
+    // 3. maskedExpr = Mask && expr = 0000 0000 1001 0000
+    Value* maskedExpr = Builder.CreateAnd(mask, shifted);
+
+    // 4. invertedMask = 1111 1111 0000 1111
+    Value* invertedMask = Builder.CreateNot(mask);
+
+    // 5. safeValue = value && invertedMask = xxxx xxxx 0000 xxxx //reset the slice bits in value to 0
+    Value* safeValue = Builder.CreateAnd(value, invertedMask);
+
+    // 6. computedValue = maskedExpr | safeValue = xxxx xxxx 1001 xxxx
+    return Builder.CreateOr(maskedExpr, safeValue);
+  }
+
+  // Reductions
+  //
+  // Each reduce form is a single compare or a ctpop, never a loop over bits.
+  // The all-ones and set-bit tests look at the 32 bits of the i32 value.
+
+  // Declare an overloaded intrinsic on type, once per module
+  Function* getIntrinsic(Intrinsic::ID id, Type* type) {
+    return Intrinsic::getDeclaration(M, id, {type});
+  }
+
+  // 1 if every bit of value is set
+  Value* reduceAnd(Value* value) {
+    // Zero extended from fewer bits, the top bit is clear
+    if (widthOf(value) < 32)
+      return Builder.getInt1(false);
+    return Builder.CreateICmpEQ(toInt32(value), Builder.getInt32(0xFFFFFFFF));
+  }
+
+  // 1 if any bit of value is set
+  Value* reduceOr(Value* value) {
+    return Builder.CreateICmpNE(value, ConstantInt::get(value->getType(), 0));
+  }
+
+  // Number of set bits
+  Value* reducePlus(Value* value) {
+    return Builder.CreateCall(getIntrinsic(Intrinsic::ctpop, value->getType()), {value});
+  }
+
+  // Parity, the lowest bit of the number of set bits
+  Value* reduceXor(Value* value) {
+    // A single bit is its own parity
+    if (widthOf(value) == 1)
+      return value;
+    return resize(reducePlus(value), 1);
+  }
+
+  // Batch entry point
+  //
+  // f_batch(in0, ..., out, n) sets out[i] = f(in0[i], ...) for i < n. The
+  // arrays must not overlap. f is inlined into the loop, and the loop is
+  // marked for the loop vectorizer, so once optimized one iteration handles
+  // several elements. Only emitted with -batch. The module gets no target
+  // triple; the vector width is up to whatever compiles it.
+  void emitBatchFunction(Function* F) {
+    LLVMContext &C = F->getContext();
+    Type* intType = Builder.getInt32Ty();
+    Type* arrayType = PointerType::getUnqual(intType);
+
+    // One array per input, the output array, and the element count
+    vector<Type*> params(F->arg_size() + 1, arrayType);
+    params.push_back(intType);
+    FunctionType* batchType = FunctionType::get(Builder.getVoidTy(), params, false);
+    Function* batch = Function::Create(batchType, GlobalValue::ExternalLinkage,
+                                       F->getName() + "_batch", M);
+    for (Argument &a : batch->args())
+      if (a.getType()->isPointerTy())
+        a.addAttr(Attribute::NoAlias);
+    Argument* out = batch->getArg(F->arg_size());
+    Argument* n = batch->getArg(F->arg_size() + 1);
+
+    BasicBlock* entry = BasicBlock::Create(C, "entry", batch);
+    BasicBlock* loop = BasicBlock::Create(C, "loop", batch);
+    BasicBlock* exit = BasicBlock::Create(C, "exit", batch);
+
+    Builder.SetInsertPoint(entry);
+    Builder.CreateCondBr(Builder.CreateICmpSGT(n, Builder.getInt32(0)), loop, exit);
+
+    // out[i] = f(in0[i], ...)
+    Builder.SetInsertPoint(loop);
+    PHINode* i = Builder.CreatePHI(intType, 2);
+    i->addIncoming(Builder.getInt32(0), entry);
+    vector<Value*> args;
+    for (unsigned j = 0; j < F->arg_size(); j++)
+      args.push_back(Builder.CreateLoad(intType, Builder.CreateInBoundsGEP(intType, batch->getArg(j), i)));
+    CallInst* call = Builder.CreateCall(F, args);
+    Builder.CreateStore(call, Builder.CreateInBoundsGEP(intType, out, i));
+    Value* next = Builder.CreateAdd(i, Builder.getInt32(1), "", true, true);
+    i->addIncoming(next, loop);
+    BranchInst* latch = Builder.CreateCondBr(Builder.CreateICmpSLT(next, n), loop, exit);
+
+    // !llvm.loop !{self, !{"llvm.loop.vectorize.enable", true}}
+    Metadata* enable[] = {MDString::get(C, "llvm.loop.vectorize.enable"),
+                          ConstantAsMetadata::get(Builder.getTrue())};
+    Metadata* loopID[] = {nullptr, MDNode::get(C, enable)};
+    MDNode* loopMD = MDNode::getDistinct(C, loopID);
+    loopMD->replaceOperandWith(0, loopMD);
+    latch->setMetadata(LLVMContext::MD_loop, loopMD);
+
+    Builder.SetInsertPoint(exit);
+    Builder.CreateRetVoid();
+
+    InlineFunctionInfo info;
+    InlineFunction(*call, info);
+  }
+
+  // Look up the current value of a variable used in an expression
+  Value* handleBitsliceID(char* id) {
+    bitsliceIsID = true;
+    bitsliceRange = Builder.getInt32(1);
+    if (valueSliceDict.find(string(id)) == valueSliceDict.end()) {
+      printf("Variable %s not defined\n", id);
+      return nullptr;
+    }
+    return valueSliceDict[string(id)].value;
+  }
+};
 
 %}
 
@@ -196,6 +533,24 @@ Value* getMaskedValue(Value* value, Slice slice) {
 
 /*%define parse.trace*/
 
+%define api.pure full
+%parse-param {yyscan_t scanner} {P1Parser &p1}
+%lex-param {yyscan_t scanner}
+
+%code requires {
+typedef void* yyscan_t;
+class P1Parser;
+}
+
+// Need for parser and scanner
+%code {
+int yylex_init(yyscan_t* scanner);
+void yyset_in(FILE* in, yyscan_t scanner);
+int yylex_destroy(yyscan_t scanner);
+int yylex(YYSTYPE* lvalp, yyscan_t scanner);
+void yyerror(yyscan_t scanner, P1Parser &p1, const char* msg);
+}
+
 %type <params_list> params_list
 
 %type <val> expr
@@ -237,16 +592,18 @@ inputs:               IN params_list ENDLINE
                         std::vector<Type*> param_types;
                         for(auto s: *$2)
                           {
-                            param_types.push_back(Builder.getInt32Ty());
+                            param_types.push_back(p1.Builder.getInt32Ty());
                           }
                         ArrayRef<Type*> Params (param_types);
                         
                         // Create int function type with no arguments
                         FunctionType *FunType = 
-                          FunctionType::get(Builder.getInt32Ty(),Params,false);
+                          FunctionType::get(p1.Builder.getInt32Ty(),Params,false);
 
                         // Create a main function
-                        Function *Function = Function::Create(FunType,GlobalValue::ExternalLinkage,funName,M);
+                        Function *Function = Function::Create(FunType,GlobalValue::ExternalLinkage,p1.funName,p1.M);
+
+                        p1.F = Function;
 
                         int arg_no=0;
                         for(auto &a: Function->args()) {
@@ -254,28 +611,29 @@ inputs:               IN params_list ENDLINE
                           // get first element from vector $2,
                           string arg_name = $2->at(arg_no);
                           // match name to position
-                          addNewValue(arg_name, &a);
+                          p1.addNewValue(arg_name, &a);
                           arg_no++;
                         }
                         
                         //Add a basic block to main to hold instructions, and set Builder
                         //to insert there
-                        Builder.SetInsertPoint(BasicBlock::Create(TheContext, "entry", Function));
+                        p1.Builder.SetInsertPoint(BasicBlock::Create(p1.M->getContext(), "entry", Function));
 
                       }
                       | IN NONE ENDLINE
                       { 
                         // Create int function type with no arguments
                         FunctionType *FunType = 
-                          FunctionType::get(Builder.getInt32Ty(),false);
+                          FunctionType::get(p1.Builder.getInt32Ty(),false);
 
                         // Create a main function
                         Function *Function = Function::Create(FunType,  
-                              GlobalValue::ExternalLinkage,funName,M);
+                              GlobalValue::ExternalLinkage,p1.funName,p1.M);
+                        p1.F = Function;
 
                         //Add a basic block to main to hold instructions, and set Builder
                         //to insert there
-                        Builder.SetInsertPoint(BasicBlock::Create(TheContext, "entry", Function));
+                        p1.Builder.SetInsertPoint(BasicBlock::Create(p1.M->getContext(), "entry", Function));
                       }
                       ;
 
@@ -292,7 +650,19 @@ params_list:          ID
                       }
                       ;
 
-final:                FINAL expr ENDLINE { Builder.CreateRet($2); }
+final:                FINAL expr ENDLINE
+                      {
+                        p1.Builder.CreateRet(p1.toInt32($2));
+                        // Slices merged in {...} leave their parts unused
+                        BasicBlock* BB = p1.Builder.GetInsertBlock();
+                        for (Instruction &I : make_early_inc_range(reverse(*BB)))
+                          if (isInstructionTriviallyDead(&I))
+                            I.eraseFromParent();
+                        p1.sliceOrigin.clear();
+
+                        if (p1.batch)
+                          p1.emitBatchFunction(BB->getParent());
+                      }
                       ;
 
 statements_opt:       %empty {}
@@ -313,43 +683,27 @@ statement:            bitslice_lhs ASSIGN expr ENDLINE
                         // Output: xxxx xxxx 1001 xxxx
 
                         // 0. Check if value present in valueSliceDict
-                        if(valueSliceDict.find(string($1)) != valueSliceDict.end())
+                        if(p1.valueSliceDict.find(string($1)) != p1.valueSliceDict.end())
                         {
                           // 0. Input parameters
                           // Get valueSlice from valueSliceDict using bitslice_lhs key
-                          ValueSlice valueSlice = valueSliceDict[string($1)];
+                          ValueSlice valueSlice = p1.valueSliceDict[string($1)];
 
                           Slice slice = valueSlice.slice;
                           Value* value = valueSlice.value;
 
-                          // 1. Mask = 0000 0000 1111 0000
-                          // Get mask using slice of valueSlice
-                          Value* mask = createMask(slice.start, slice.range);
-
-                          // 2. expr = inputExpr << slice.start = xxxx xxxx 1001 xxxx
-                          Value* expr = Builder.CreateShl($3, slice.start);
-
-                          // 3. maskedExpr = Mask && expr = 0000 0000 1001 0000
-                          Value* maskedExpr = Builder.CreateAnd(mask, expr);
-
-                          // 4. invertedMask = 1111 1111 0000 1111
-                          Value* invertedMask = Builder.CreateNot(mask);
-
-                          // 5. safeValue = value && invertedMask = xxxx xxxx 0000 xxxx //reset the slice bits in value to 0
-                          Value* safeValue = Builder.CreateAnd(value, invertedMask);
+                          // 1. Write expr into the slice bits of value
+                          Value* computedValue = p1.setMaskedValue(value, slice, $3);
 
-                          // 6. computedValue = maskedExpr | safeValue = xxxx xxxx 1001 xxxx
-                          Value* computedValue = Builder.CreateOr(maskedExpr, safeValue);
-
-                          // 7. Cleanup Slice Mask in valueSlice after assigning the bitslice
-                          valueSlice.slice = defaultSlice();
+                          // 2. Cleanup Slice Mask in valueSlice after assigning the bitslice
+                          valueSlice.slice = p1.defaultSlice();
                           valueSlice.value = computedValue;
-                          valueSliceDict[string($1)] = valueSlice;
+                          p1.valueSliceDict[string($1)] = valueSlice;
 
                         } else {
                           // Value not in dictionary
                           // So, just add it
-                          addNewValue(string($1), $3);
+                          p1.addNewValue(string($1), $3);
                         }
                       }
                       | SLICE field_list ENDLINE
@@ -364,17 +718,17 @@ statement:            bitslice_lhs ASSIGN expr ENDLINE
 
                         int arg_no = 0;
                         // For Loop over contents of global vector bitsliceFieldIds
-                        for(auto field: bitsliceFieldIds)
+                        for(auto field: p1.bitsliceFieldIds)
                         {
-                          Slice slice = defaultSlice();
-                          slice.start = Builder.getInt32(arg_no);
-                          slicesDict[field] = slice;
+                          Slice slice = p1.defaultSlice();
+                          slice.start = p1.Builder.getInt32(arg_no);
+                          p1.slicesDict[field] = slice;
                           arg_no++;
                         }
 
 
                         // reset the global variable here
-                        bitsliceFieldIds.clear();
+                        p1.bitsliceFieldIds.clear();
                       }
                       ;
 
@@ -387,50 +741,48 @@ field:                ID COLON expr
                         // a:4
                         // Make Slice struct with start=$3 and range=1, and store in slicesDict
 
-                        Slice slice = Slice{$3, Builder.getInt32(1)};
-                        addSlice(string($1), slice);
+                        Slice slice = Slice{p1.toInt32($3), p1.Builder.getInt32(1)};
+                        p1.addSlice(string($1), slice);
                       }
                       | ID LBRACKET expr RBRACKET COLON expr 
                       {
                         // a[4]:2
                         // Make new Slice, start = $6, range = $3
-                        Slice slice = {$6, $3};
+                        Slice slice = {p1.toInt32($6), p1.toInt32($3)};
                         // Store the value in slices Dictionary
-                        addSlice(string($1), slice);
+                        p1.addSlice(string($1), slice);
                       }
 // 566 only below
                       | ID 
                       {
                         // Insert ID into bitsliceFieldIds at first position
-                        bitsliceFieldIds.insert(bitsliceFieldIds.begin(), string($1));
+                        p1.bitsliceFieldIds.insert(p1.bitsliceFieldIds.begin(), string($1));
                         // bitsliceFieldIds.push_back(string($1));
                       }
                       ;
 
 expr:                 bitslice  { $$ = $1; }
-                      | expr PLUS expr    { $$ = Builder.CreateAdd($1, $3); }
-                      | expr MINUS expr   { $$ = Builder.CreateSub($1, $3); }
-                      | expr XOR expr     { $$ = Builder.CreateXor($1, $3); }
-                      | expr AND expr     { $$ = Builder.CreateAnd($1, $3); }
-                      | expr OR expr      { $$ = Builder.CreateOr($1, $3); }
-                      | INV expr          { $$ = Builder.CreateNot($2); }
+                      | expr PLUS expr    { $$ = p1.Builder.CreateAdd(p1.toInt32($1), p1.toInt32($3)); }
+                      | expr MINUS expr   { $$ = p1.Builder.CreateSub(p1.toInt32($1), p1.toInt32($3)); }
+                      | expr XOR expr     { p1.sameWidth($1, $3); $$ = p1.Builder.CreateXor($1, $3); }
+                      | expr AND expr     { p1.sameWidth($1, $3); $$ = p1.Builder.CreateAnd($1, $3); }
+                      | expr OR expr      { p1.sameWidth($1, $3); $$ = p1.Builder.CreateOr($1, $3); }
+                      | INV expr          { $$ = p1.Builder.CreateNot(p1.toInt32($2)); }
                       | BINV expr 
                       {
                         // Flip the LSB, by using XOR operation with 1
-                        Value* one = Builder.getInt32(1);
-                        $$ = Builder.CreateXor($2, one);
+                        Value* one = ConstantInt::get($2->getType(), 1);
+                        $$ = p1.Builder.CreateXor($2, one);
                       }
-                      | expr MUL expr     {$$ = Builder.CreateMul($1, $3);}
-                      | expr DIV expr     {$$ = Builder.CreateSDiv($1, $3);}
-                      | expr MOD expr     {$$ = Builder.CreateSRem($1, $3);}
+                      | expr MUL expr     {$$ = p1.Builder.CreateMul(p1.toInt32($1), p1.toInt32($3));}
+                      | expr DIV expr     {$$ = p1.Builder.CreateSDiv(p1.toInt32($1), p1.toInt32($3));}
+                      | expr MOD expr     {$$ = p1.Builder.CreateSRem(p1.toInt32($1), p1.toInt32($3));}
 /* 566 only */
                       | REDUCE AND LPAREN expr RPAREN
                       {
                         // 111111 -> 1
                         // 101101 -> 0
-                        // Divide by 111111 all 1s
-                        // Divide expr by 0xFFFFFFFF
-                        $$ = Builder.CreateUDiv($4, Builder.getInt32(0xFFFFFFFF));
+                        $$ = p1.reduceAnd($4);
                       }
                       | REDUCE OR LPAREN expr RPAREN 
                       {
@@ -438,15 +790,7 @@ expr:                 bitslice  { $$ = $1; }
                         // 11111 -> 1
                         // 00000 -> 0
                         // 100000 -> 1
-                        
-                        // If value greater than 1, return 1
-
-                        // Check if value is greater than 1
-                        Value* boolean = Builder.CreateICmpUGT($4, Builder.getInt32(0));
-
-                        // Convert boolean to integer
-                        $$ = Builder.CreateZExt(boolean, Builder.getInt32Ty());
-
+                        $$ = p1.reduceOr($4);
                       }
                       | REDUCE XOR LPAREN expr RPAREN 
                       {
@@ -454,42 +798,20 @@ expr:                 bitslice  { $$ = $1; }
                         // 00000 -> 0
                         // 11111 -> 1
                         // 11110 -> 0
-                        // XOR all the bitfields
-                        // Add all the individual bits of expr
-                        
-                        Value* xor_temp = Builder.getInt32(0);
-
-                        for (int i = 0; i < 32; i++)
-                        {
-                          // Get i bit from expr
-                          Value* bit = getBit($4, i);
-                          // Add the bit to xor
-                          xor_temp = Builder.CreateXor(xor_temp, bit);
-                        }
-                        $$ = xor_temp;
-
+                        $$ = p1.reduceXor($4);
                       }
                       | REDUCE PLUS LPAREN expr RPAREN 
                       {
                         // Return LLVM CTPOP instructions
-                        Function* ctpop = M->getFunction("llvm.ctpop.i32");
-                        vector<Type*>ctpop_args;
-                        ctpop_args.push_back(Builder.getInt32Ty());
-                        FunctionType *ctpop_type = FunctionType::get(Builder.getInt32Ty(), ctpop_args, false);
-                        ctpop = llvm::Function::Create(ctpop_type, GlobalValue::ExternalLinkage, "llvm.ctpop.i32", M);
-                        Value* ctpop_call = Builder.CreateCall(ctpop, $4);
-                        $$ = ctpop_call;
+                        $$ = p1.reducePlus($4);
                       }
                       | EXPAND LPAREN expr RPAREN 
                       {                        
                         // get lowest bit of expr
-                        Value* lowest_bit = getLowestBit($3);
+                        Value* lowest_bit = p1.getLowestBit($3);
                         
-                        // Make a value of maximum unsigned 32 bits
-                        Value* max_32 = Builder.getInt32(0xFFFFFFFF);
-
-                        // Multiply lowest_bit and max_32, so it fills all the 32 bits
-                        Value* result = Builder.CreateMul(lowest_bit, max_32);
+                        // Sign extend the i1, so it fills all the 32 bits
+                        Value* result = p1.Builder.CreateSExt(lowest_bit, p1.Builder.getInt32Ty());
 
                         $$ = result;
                       }
@@ -497,13 +819,15 @@ expr:                 bitslice  { $$ = $1; }
 
 bitslice:             ID 
                       { 
-                        $$ = handleBitsliceID($$, $1);
+                        $$ = p1.handleBitsliceID($1);
+                        if ($$ == nullptr)
+                          YYABORT;
                       }
                       | NUMBER 
                       {
-                        bitsliceIsID = true;
-                        bitsliceRange = Builder.getInt32(1);
-                        $$ = Builder.getInt32($1);
+                        p1.bitsliceIsID = true;
+                        p1.bitsliceRange = p1.Builder.getInt32(1);
+                        $$ = p1.getConstant($1);
                       }
                       | bitslice_list 
                       {
@@ -511,50 +835,50 @@ bitslice:             ID
                       }
                       | LPAREN expr RPAREN 
                       {
-                        bitsliceIsID = false;
-                        bitsliceRange = Builder.getInt32(1);
+                        p1.bitsliceIsID = false;
+                        p1.bitsliceRange = p1.Builder.getInt32(1);
                         $$ = $2;
                       }
                       | bitslice NUMBER
                       {
-                        bitsliceIsID = false;
-                        bitsliceRange = Builder.getInt32(1);
-                        $$ = getBit($1,Builder.getInt32($2));
+                        p1.bitsliceIsID = false;
+                        p1.bitsliceRange = p1.Builder.getInt32(1);
+                        $$ = p1.getBit($1,p1.Builder.getInt32($2));
                       }
                       | bitslice DOT ID 
                       {
-                        bitsliceIsID = false;
+                        p1.bitsliceIsID = false;
                         // From slicesDict, grab value of Slice using key ID
                         // Check if slicesDict has key ID
-                        if (slicesDict.find(string($3)) != slicesDict.end())
+                        if (p1.slicesDict.find(string($3)) != p1.slicesDict.end())
                         {
-                          Slice slice = slicesDict[string($3)];
-                          bitsliceRange = slice.range;
+                          Slice slice = p1.slicesDict[string($3)];
+                          p1.bitsliceRange = slice.range;
                           // Input: slice(start, range), bitslice
-                          $$ = getMaskedValue($1, slice);
+                          $$ = p1.getMaskedValue($1, slice);
                         }
                         else { 
                           printf("Key %s not found in slicesDict\n", string($3).c_str());
-                          yyerror("Slice not found in slicesDict"); }
+                          yyerror(scanner, p1, "Slice not found in slicesDict"); }
                       }
 // 566 only
                       | bitslice LBRACKET expr RBRACKET 
                       {
-                        bitsliceIsID = false;
-                        bitsliceRange = Builder.getInt32(1);
-                        $$ = getBit($1,$3); 
+                        p1.bitsliceIsID = false;
+                        p1.bitsliceRange = p1.Builder.getInt32(1);
+                        $$ = p1.getBit($1,p1.toInt32($3)); 
                       }
                       | bitslice LBRACKET expr COLON expr RBRACKET 
                       {
-                        bitsliceIsID = false;
+                        p1.bitsliceIsID = false;
 
                         // [4:2], [4:4]
                         // start = $5 = 2, range = $3-$5+1 = 3 ; start = 4, range = 4-4+1 = 1
                         // range = $3 - $5 + 1)
-                        Value* range = Builder.CreateAdd(Builder.CreateSub($3, $5), Builder.getInt32(1));
-                        Slice slice = Slice{$3, range};
-                        bitsliceRange = Builder.getInt32(1);;
-                        $$ = getMaskedValue($1, slice);
+                        Value* range = p1.Builder.CreateAdd(p1.Builder.CreateSub(p1.toInt32($3), p1.toInt32($5)), p1.Builder.getInt32(1));
+                        Slice slice = Slice{p1.toInt32($3), range};
+                        p1.bitsliceRange = p1.Builder.getInt32(1);;
+                        $$ = p1.getMaskedValue($1, slice);
                       }
                       ;
 
@@ -565,17 +889,17 @@ bitslice_list_helper: bitslice
                       {
                         // Information: bitslice Val* object
                         // start tracking bitslice
-                        $$ = bitsliceIsID ? getLowestBit($1) : $1;
-                        bitsliceIsID = false;
+                        $$ = p1.bitsliceIsID ? p1.getLowestBit($1) : $1;
+                        p1.bitsliceIsID = false;
                       }
                       | bitslice_list_helper COMMA bitslice 
                       {
                         // TODO: For wide bitslices, use a global variable
 
-                        Value* bslice = bitsliceIsID ? getLowestBit($3) : $3;
-                        bitsliceIsID = false;
-                        $$ = do_leftshiftbyn_add($1,bitsliceRange,bslice);
-                        bitsliceRange = Builder.getInt32(1);
+                        Value* bslice = p1.bitsliceIsID ? p1.getLowestBit($3) : $3;
+                        p1.bitsliceIsID = false;
+                        $$ = p1.do_leftshiftbyn_add($1,p1.bitsliceRange,bslice);
+                        p1.bitsliceRange = p1.Builder.getInt32(1);
                       }
 ;
 
@@ -584,56 +908,56 @@ bitslice_lhs:         ID { $$ = $1; }
                         // a1
                         // return single masked bit, use getBit
                         // check if valueSliceDict has key $1
-                        if (valueSliceDict.find(string($1)) != valueSliceDict.end())
+                        if (p1.valueSliceDict.find(string($1)) != p1.valueSliceDict.end())
                         {
                           // Get valueSlice from valueSliceDict
-                          ValueSlice valueSlice = valueSliceDict[string($1)];
+                          ValueSlice valueSlice = p1.valueSliceDict[string($1)];
                           // Make and add a slice to the valueSliceDict[$1]
 
                           // Initialize a new slice, with start = $2, range = 1
-                          Slice slice = Slice{Builder.getInt32($2), Builder.getInt32(1)};
+                          Slice slice = Slice{p1.Builder.getInt32($2), p1.Builder.getInt32(1)};
 
                           // Add slice to valueSlice
                           valueSlice.slice = slice;
                           
                           $$ = $1;
                         }
-                        else { yyerror("Slice not found for bitslice_lhs"); }
+                        else { yyerror(scanner, p1, "Slice not found for bitslice_lhs"); }
                        }
                       | bitslice_lhs DOT ID 
                       {
-                        if (slicesDict.find(string($3)) != slicesDict.end())
+                        if (p1.slicesDict.find(string($3)) != p1.slicesDict.end())
                         {
                           // x = 0; slice five:5
 
                           // Input: bitslice_lhs: char*, ID: char*
 
                           // We get values from the char* Dictionaries: ValueSlice, Slice
-                          Slice slice = slicesDict[(string)$3];
+                          Slice slice = p1.slicesDict[(string)$3];
 
                           // Output: Update ValueSlice's slice with new Slice
                           
                           ValueSlice valueSlice;
                           // check if $1 is in ValueSliceDict else throw exception
-                          if (valueSliceDict.find(string($1)) != valueSliceDict.end())
+                          if (p1.valueSliceDict.find(string($1)) != p1.valueSliceDict.end())
                           {
-                            valueSlice = valueSliceDict[string($1)];
+                            valueSlice = p1.valueSliceDict[string($1)];
                             // existing slice
                             Slice existingSlice = valueSlice.slice;
                             
                             // Slice the slice further
                             // existingSlice, slice
                             // Start = existingSlice.start + slice.start
-                            Value* start = Builder.CreateAdd(existingSlice.start, slice.start);                           
+                            Value* start = p1.Builder.CreateAdd(existingSlice.start, slice.start);                           
                             Slice newSlice = Slice{start, slice.range};
                             valueSlice.slice = newSlice;
                           }
                           else {
                              // If not found, create a new value
-                              valueSlice = ValueSlice{Builder.getInt32(0), slice};
+                              valueSlice = ValueSlice{p1.Builder.getInt32(0), slice};
                           }
 
-                          valueSliceDict[string($1)] = valueSlice;
+                          p1.valueSliceDict[string($1)] = valueSlice;
                         }
                         else { YYERROR; }
                         $$ = $1;
@@ -645,83 +969,83 @@ bitslice_lhs:         ID { $$ = $1; }
                         // a[4]
                         // Since this is bitslice_lhs, update value of slice in valueSliceDict
                         // 0. check if valueSliceDict has key $1
-                        if (valueSliceDict.find(string($1)) != valueSliceDict.end())
+                        if (p1.valueSliceDict.find(string($1)) != p1.valueSliceDict.end())
                         {
                           // 1. Get valueSlice from valueSliceDict
-                          ValueSlice valueSlice = valueSliceDict[string($1)];
+                          ValueSlice valueSlice = p1.valueSliceDict[string($1)];
                           
                           // Make and add a slice to the valueSliceDict[$1]
 
                           // 2. Initialize a new slice, with start = $3, range = 1
-                          Slice slice = Slice{$3, Builder.getInt32(1)};
+                          Slice slice = Slice{p1.toInt32($3), p1.Builder.getInt32(1)};
 
                           // 3. Add slice to valueSlice
                           valueSlice.slice = slice;
                           
                           // 4. Update valueSliceDict with new slice
-                          valueSliceDict[string($1)] = valueSlice;
+                          p1.valueSliceDict[string($1)] = valueSlice;
                         }
-                        else { yyerror("Slice not found for bitslice_lhs"); }
+                        else { yyerror(scanner, p1, "Slice not found for bitslice_lhs"); }
                       }
                       | bitslice_lhs LBRACKET expr COLON expr RBRACKET 
                       {
                         // [4:2], [4:4]
                         // start = $5 = 2, range = $3-$5+1 = 3 ; start = 4, range = 4-4+1 = 1
                         // range = $3 - $5 + 1)
-                        Value* range = Builder.CreateAdd(Builder.CreateSub($3, $5), Builder.getInt32(1));
-                        Slice slice = Slice{$3, range};
+                        Value* range = p1.Builder.CreateAdd(p1.Builder.CreateSub(p1.toInt32($3), p1.toInt32($5)), p1.Builder.getInt32(1));
+                        Slice slice = Slice{p1.toInt32($3), range};
 
                         // Update slice in valueSlice dictionary
                         // 0. check if valueSliceDict has key $1
-                        if (valueSliceDict.find(string($1)) != valueSliceDict.end())
+                        if (p1.valueSliceDict.find(string($1)) != p1.valueSliceDict.end())
                         {
                           // 1. Get valueSlice from valueSliceDict
-                          ValueSlice valueSlice = valueSliceDict[string($1)];
+                          ValueSlice valueSlice = p1.valueSliceDict[string($1)];
                           
                           // 2. Update valueSlice's slice with new Slice
                           valueSlice.slice = slice;
                           
                           // 3. Update valueSliceDict with new slice
-                          valueSliceDict[string($1)] = valueSlice;
+                          p1.valueSliceDict[string($1)] = valueSlice;
                         }
-                        else { yyerror("Slice not found for bitslice_lhs"); }
+                        else { yyerror(scanner, p1, "Slice not found for bitslice_lhs"); }
                       }
 ;
 
 %%
 
-unique_ptr<Module> parseP1File(const string &InputFilename)
+// Compile InputFilename into a function of M named after the file, and with
+// Batch its batch entry point. Returns false, leaving M as it was, if the
+// file has errors.
+bool parseP1File(const string &InputFilename, Module &M, bool Batch)
 {
-  funName = InputFilename;
-  if (funName.find_last_of('/') != string::npos)
-    funName = funName.substr(funName.find_last_of('/')+1);
-  if (funName.find_last_of('.') != string::npos)
-    funName.resize(funName.find_last_of('.'));
-    
-  //errs() << "Function will be called " << funName << ".\n";
-  
-  // unique_ptr will clean up after us, call destructor, etc.
-  unique_ptr<Module> Mptr(new Module(funName.c_str(), TheContext));
-
-  // set global module
-  M = Mptr.get();
-  
-  /* this is the name of the file to generate, you can also use
-     this string to figure out the name of the generated function */
-  yyin = fopen(InputFilename.c_str(),"r");
+  P1Parser p1(&M, sys::path::stem(InputFilename).str(), Batch);
+
+  //errs() << "Function will be called " << p1.funName << ".\n";
+
+  FILE* in = fopen(InputFilename.c_str(),"r");
+  if (in == nullptr) {
+    printf("Cannot open %s\n", InputFilename.c_str());
+    return false;
+  }
+
+  yyscan_t scanner;
+  yylex_init(&scanner);
+  yyset_in(in, scanner);
 
   //yydebug = 1;
-  if (yyparse() != 0)
-    // errors, so discard module
-    Mptr.reset();
-  else
-    // Dump LLVM IR to the screen for debugging
-    M->print(errs(),nullptr,false,true);
-  
-  return Mptr;
+  int errors = yyparse(scanner, p1);
+
+  yylex_destroy(scanner);
+  fclose(in);
+
+  // errors, so discard the function
+  if (errors != 0 && p1.F != nullptr)
+    p1.F->eraseFromParent();
+  return errors == 0;
 }
 
-void yyerror(const char* msg)
+void yyerror(yyscan_t scanner, P1Parser &p1, const char* msg)
 {
   printf("%s\n",msg);
 }
@@ -0,0 +1,81 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Throughput of a p1 program called once per element against its batch
+// entry point. Compile with these flags
+// -DTEST=<funcname> -DNARGS=<number of inputs, 0 to 2>
+
+#define CONCAT(a,b) CONCAT_(a,b)
+#define CONCAT_(a,b) a##b
+#define BATCH CONCAT(TEST,_batch)
+
+#ifndef NARGS
+#define NARGS 1
+#endif
+
+#if NARGS == 0
+int TEST();
+void BATCH(int *out, int n);
+#define CALL(i) TEST()
+#define CALL_BATCH(out,n) BATCH(out,n)
+#elif NARGS == 1
+int TEST(int);
+void BATCH(const int *a, int *out, int n);
+#define CALL(i) TEST(a[i])
+#define CALL_BATCH(out,n) BATCH(a,out,n)
+#else
+int TEST(int, int);
+void BATCH(const int *a, const int *b, int *out, int n);
+#define CALL(i) TEST(a[i],b[i])
+#define CALL_BATCH(out,n) BATCH(a,b,out,n)
+#endif
+
+#define ELEMENTS (1<<16)
+#define ROUNDS 200
+
+static double now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main()
+{
+  int *a = malloc(sizeof(int)*ELEMENTS);
+  int *b = malloc(sizeof(int)*ELEMENTS);
+  int *scalar = malloc(sizeof(int)*ELEMENTS);
+  int *batch = malloc(sizeof(int)*ELEMENTS);
+
+  srand(566);
+  for(int i=0; i<ELEMENTS; i++)
+    {
+      a[i] = rand();
+      b[i] = rand() % 32;
+    }
+
+  double start = now();
+  for(int r=0; r<ROUNDS; r++)
+    for(int i=0; i<ELEMENTS; i++)
+      scalar[i] = CALL(i);
+  double scalar_time = now() - start;
+
+  start = now();
+  for(int r=0; r<ROUNDS; r++)
+    CALL_BATCH(batch,ELEMENTS);
+  double batch_time = now() - start;
+
+  for(int i=0; i<ELEMENTS; i++)
+    if (scalar[i] != batch[i])
+      {
+	printf("Element %d: batch gave %d but the scalar entry point gave %d.\n",
+	       i,batch[i],scalar[i]);
+	return 1;
+      }
+
+  double elements = (double)ELEMENTS * ROUNDS;
+  printf("scalar,%.0f\nbatch,%.0f\nspeedup,%.2f\n",elements/scalar_time,
+	 elements/batch_time,scalar_time/batch_time);
+  return 0;
+}
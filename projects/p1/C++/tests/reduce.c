@@ -0,0 +1,45 @@
+#include <stdio.h>
+
+int reduce(int x);
+
+int popcount(unsigned x)
+{
+  int n = 0;
+  for (; x; x >>= 1)
+    n += x & 1;
+  return n;
+}
+
+int reduce_tester(int x)
+{
+  int p = popcount(x) & 1;
+  int a = x == -1;
+  int o = x != 0;
+  int n = popcount(x);
+  int m = popcount(x ^ 1);
+  int q = x & 1;
+  return p + a*2 + o*4 + n*8 + m*512 + q*32768;
+}
+
+
+int main()
+{
+  int special[] = { 0, 1, -1, -2, 0x7fffffff, 0x80000000 };
+  for(int i=0; i<6; i++)
+    if (reduce(special[i]) != reduce_tester(special[i]))
+      {
+	printf("reduce(%d) returned %d but %d was expected.\n",special[i],
+	       reduce(special[i]),reduce_tester(special[i]));
+	return 1;
+      }
+  for(int i=0; i<10000; i++)
+    {
+      if (reduce(i) != reduce_tester(i))
+	{
+	  printf("reduce(%d) returned %d but %d was expected.\n",i,reduce(i),
+		 reduce_tester(i));
+	  return 1;
+	}
+    }
+  return 0;
+}
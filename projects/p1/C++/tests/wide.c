@@ -0,0 +1,29 @@
+#include <stdio.h>
+
+int wide(int a, int b);
+int wide_tester(int a, int b)
+{
+  // Every value wraps at bit 32, however its parts are computed, so the 8
+  // bits from bit 31 up are just bit 31
+  unsigned x = (unsigned)a << 1 | (b & 1);
+  unsigned y = ((unsigned)a + (unsigned)b) << 1 | (b & 1);
+  return (int)((x >> 31 << 16 | x >> 31 << 8 | y >> 31) ^ x >> 31);
+}
+
+
+int main()
+{
+  for(int i=0; i<10000; i++)
+    {
+      int a = i * 0x9e3779b9, b = ~i * 0x85ebca6b;
+      if (wide(a,b) != wide_tester(a,b))
+	{
+	  printf("wide(%d,%d) returned %d but %d was expected.\n",a,b,wide(a,b),
+		 wide_tester(a,b));
+	  return 1;
+	}
+    }
+  if (wide(0xffffffff,0) != wide_tester(0xffffffff,0))
+    return 1;
+  return 0;
+}
@@ -0,0 +1,24 @@
+#include <stdio.h>
+
+int zero(int a, int b);
+int zero_tester(int a, int b)
+{
+  // Slices of no bits neither write nor read anything
+  return a;
+}
+
+
+int main()
+{
+  for(int i=0; i<10000; i++)
+    {
+      int a = i * 0x9e3779b9, b = ~i * 0x85ebca6b;
+      if (zero(a,b) != zero_tester(a,b))
+	{
+	  printf("zero(%d,%d) returned %d but %d was expected.\n",a,b,zero(a,b),
+		 zero_tester(a,b));
+	  return 1;
+	}
+    }
+  return 0;
+}
@@ -7,30 +7,59 @@
 
 #include "llvm-c/Core.h"
 
+#include "llvm/ADT/DepthFirstIterator.h"
+#include "llvm/ADT/Hashing.h"
+#include "llvm/ADT/ScopedHashTable.h"
+#include "llvm/ADT/SetVector.h"
 #include "llvm/ADT/Statistic.h"
+#include "llvm/ADT/STLExtras.h"
 #include "llvm/ADT/StringSet.h"
+#include "llvm/ADT/Triple.h"
+#include "llvm/Analysis/AliasAnalysis.h"
+#include "llvm/Analysis/AssumptionCache.h"
+#include "llvm/Analysis/BasicAliasAnalysis.h"
 #include "llvm/Analysis/InstructionSimplify.h"
 #include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/MemorySSA.h"
+#include "llvm/Analysis/MemorySSAUpdater.h"
+#include "llvm/Analysis/PostDominators.h"
+#include "llvm/Analysis/TargetLibraryInfo.h"
+#include "llvm/Analysis/ValueTracking.h"
 #include "llvm/Bitcode/BitcodeReader.h"
 #include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/InstIterator.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/LegacyPassManager.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Verifier.h"
 #include "llvm/IRReader/IRReader.h"
 #include "llvm/LinkAllPasses.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/Allocator.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FileUtilities.h"
+#include "llvm/Support/JSON.h"
 #include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/RecyclingAllocator.h"
+#include "llvm/Support/Signals.h"
 #include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/Timer.h"
 #include "llvm/Support/ToolOutputFile.h"
 
+#include "parallel.h"
+#include "statistics.h"
+
 using namespace llvm;
 
 static void CommonSubexpressionElimination(Module *);
+static void optimizeLazily(Module &M);
 
 static void summarize(Module *M);
-static void print_csv_file(std::string outputfile);
+static void print_csv_file(std::string outputfile, const PhaseReport &Phases);
+static void print_json_file(std::string outputfile,
+                            const PhaseReport &Phases);
 
 static cl::opt<std::string> InputFilename(cl::Positional,
                                           cl::desc("<input bitcode>"),
@@ -51,12 +80,37 @@ static cl::opt<bool> NoCSE("no-cse",
                            cl::desc("Do not perform CSE Optimization."),
                            cl::init(false));
 
+static cl::opt<bool> CSEMemSSA(
+    "cse-memssa",
+    cl::desc("Use MemorySSA and BasicAA to remove redundant loads and "
+             "stores across basic blocks."),
+    cl::init(false));
+
+static cl::opt<unsigned>
+    Threads("j",
+            cl::desc("Optimize functions in parallel on <N> threads."),
+            cl::value_desc("N"),
+            cl::init(1));
+
+static cl::opt<bool> Lazy(
+    "lazy",
+    cl::desc("Load function bodies one at a time and optimize each as soon as "
+             "it is loaded, then stream the output bitcode (flushed every "
+             "-bitcode-flush-threshold MB)."),
+    cl::init(false));
+
 static cl::opt<bool>
     Verbose("verbose", cl::desc("Verbose stats."), cl::init(false));
 
 static cl::opt<bool>
     NoCheck("no", cl::desc("Do not check for valid IR."), cl::init(false));
 
+static cl::opt<bool> TimeReport(
+    "time-report",
+    cl::desc("Time every phase of the run and sample its memory use. The "
+             "results are printed and added to the .stats files."),
+    cl::init(false));
+
 int main(int argc, char **argv) {
   // Parse command line arguments
   cl::ParseCommandLineOptions(argc, argv, "llvm system compiler\n");
@@ -65,18 +119,28 @@ int main(int argc, char **argv) {
   llvm_shutdown_obj Y; // Call llvm_shutdown() on exit.
   LLVMContext Context;
 
-  // LLVM idiom for constructing output file.
+  // LLVM idiom for constructing output file. With -lazy the writer needs a
+  // raw_fd_stream to flush to, which is opened when the output is written.
   std::unique_ptr<ToolOutputFile> Out;
   std::string ErrorInfo;
   std::error_code EC;
-  Out.reset(new ToolOutputFile(OutputFilename.c_str(), EC, sys::fs::OF_None));
+  if (!Lazy) {
+    Out.reset(
+        new ToolOutputFile(OutputFilename.c_str(), EC, sys::fs::OF_None));
+  }
 
   EnableStatistics();
+  PhaseReport Phases(TimeReport, "p2");
 
   // Read in module
+  Phases.start("parse", "Parse Input");
   SMDiagnostic Err;
   std::unique_ptr<Module> M;
-  M = parseIRFile(InputFilename, Err, Context);
+  if (Lazy) {
+    M = getLazyIRFileModule(InputFilename, Err, Context, true);
+  } else {
+    M = parseIRFile(InputFilename, Err, Context);
+  }
 
   // If errors, fail
   if (M.get() == 0) {
@@ -84,34 +148,87 @@ int main(int argc, char **argv) {
     return 1;
   }
 
-  // If requested, do some early optimizations
-  if (Mem2Reg) {
-    legacy::PassManager Passes;
-    Passes.add(createPromoteMemoryToRegisterPass());
-    Passes.run(*M.get());
-  }
+  if (Lazy && Threads <= 1) {
+    Phases.start("optimize", "Load and Optimize Functions");
+    optimizeLazily(*M);
+  } else {
+    // The parallel driver starts from the bitcode of the whole module, so
+    // there is nothing to gain from loading it lazily
+    if (Error E = M->materializeAll()) {
+      errs() << argv[0] << ": " << toString(std::move(E)) << "\n";
+      return 1;
+    }
 
-  if (!NoCSE) {
-    CommonSubexpressionElimination(M.get());
+    // If requested, do some early optimizations
+    if (Mem2Reg) {
+      Phases.start("mem2reg", "Memory to Register Promotion");
+      StatsScope Scope("mem2reg");
+      legacy::PassManager Passes;
+      Passes.add(createPromoteMemoryToRegisterPass());
+      Passes.run(*M.get());
+    }
+
+    if (!NoCSE) {
+      Phases.start("cse", "Common Subexpression Elimination");
+      CommonSubexpressionElimination(M.get());
+    }
   }
 
   // Collect statistics on Module
+  Phases.start("summarize", "Summarize Module");
   summarize(M.get());
-  print_csv_file(OutputFilename);
-
-  if (Verbose)
-    PrintStatistics(errs());
 
   // Verify integrity of Module, do this by default
   if (!NoCheck) {
+    Phases.start("verify", "Verify Module");
     legacy::PassManager Passes;
     Passes.add(createVerifierPass());
     Passes.run(*M.get());
   }
 
   // Write final bitcode
-  WriteBitcodeToFile(*M.get(), Out->os());
-  Out->keep();
+  Phases.start("write", "Write Bitcode");
+  if (Lazy) {
+    raw_fd_stream Stream(OutputFilename, EC);
+    if (EC) {
+      errs() << argv[0] << ": " << OutputFilename << ": " << EC.message()
+             << "\n";
+      return 1;
+    }
+    // Like a ToolOutputFile, a partial output is removed if the write fails
+    // or the run is interrupted
+    FileRemover Remover(OutputFilename);
+    sys::RemoveFileOnSignal(OutputFilename);
+    WriteBitcodeToFile(*M.get(), Stream);
+    Stream.close();
+    if (Stream.has_error()) {
+      errs() << argv[0] << ": " << OutputFilename << ": "
+             << Stream.error().message() << "\n";
+      Stream.clear_error();
+      return 1;
+    }
+    Remover.releaseFile();
+    sys::DontRemoveFileOnSignal(OutputFilename);
+  } else {
+    WriteBitcodeToFile(*M.get(), Out->os());
+    Out->os().close();
+    if (Out->os().has_error()) {
+      errs() << argv[0] << ": " << OutputFilename << ": "
+             << Out->os().error().message() << "\n";
+      Out->os().clear_error();
+      return 1;
+    }
+    Out->keep();
+  }
+  Phases.finish();
+
+  print_csv_file(OutputFilename, Phases);
+  print_json_file(OutputFilename, Phases);
+
+  if (Verbose)
+    PrintStatistics(errs());
+  if (TimeReport)
+    Phases.print(errs());
 
   return 0;
 }
@@ -143,29 +260,161 @@ static void summarize(Module *M) {
   }
 }
 
-static void print_csv_file(std::string outputfile) {
+static void print_csv_file(std::string outputfile, const PhaseReport &Phases) {
   std::ofstream stats(outputfile + ".stats");
+  // Sorted, since statistics register in the order they are first bumped,
+  // which differs between serial and parallel runs
   auto a = GetStatistics();
+  std::sort(a.begin(), a.end());
   for (auto p : a) {
     stats << p.first.str() << "," << p.second << std::endl;
   }
+  // Whole numbers, like the counters: microseconds and KiB
+  for (auto &P : Phases.phases()) {
+    stats << "Time." << P.Name << "," << uint64_t(P.Seconds * 1e6)
+          << std::endl;
+    stats << "PeakRSSSoFar." << P.Name << "," << P.PeakRSSSoFar
+          << std::endl;
+    stats << "Heap." << P.Name << "," << P.Heap << std::endl;
+  }
   stats.close();
 }
 
-static llvm::Statistic CSEDead = {"", "CSEDead", "CSE found dead instructions"};
-static llvm::Statistic CSEElim = {"", "CSEElim", "CSE redundant instructions"};
-static llvm::Statistic CSESimplify = {"",
-                                      "CSESimplify",
-                                      "CSE simplified instructions"};
-static llvm::Statistic CSELdElim = {"", "CSELdElim", "CSE redundant loads"};
-static llvm::Statistic CSEStore2Load = {"",
-                                        "CSEStore2Load",
-                                        "CSE forwarded store to load"};
-static llvm::Statistic CSEStElim = {"", "CSEStElim", "CSE redundant stores"};
+static void print_json_file(std::string outputfile,
+                            const PhaseReport &Phases) {
+  std::error_code EC;
+  raw_fd_ostream OS(outputfile + ".stats.json", EC, sys::fs::OF_Text);
+  if (EC) {
+    errs() << outputfile << ".stats.json: " << EC.message() << "\n";
+    return;
+  }
+  writeStatsJSON(
+      OS,
+      [](json::OStream &J) {
+        J.attribute("tool", "p2");
+        J.attribute("input", InputFilename);
+        J.attribute("output", OutputFilename);
+        J.attributeObject("options", [&] {
+          J.attribute("mem2reg", Mem2Reg.getValue());
+          J.attribute("cse", !NoCSE);
+          J.attribute("cse-memssa", CSEMemSSA.getValue());
+        });
+        J.attribute("threads", Threads.getValue());
+      },
+      &Phases);
+}
+
+static StatsCounter CSEDead = {"", "CSEDead", "CSE found dead instructions"};
+static StatsCounter CSEElim = {"", "CSEElim", "CSE redundant instructions"};
+static StatsCounter CSESimplify = {"",
+                                   "CSESimplify",
+                                   "CSE simplified instructions"};
+static StatsCounter CSELdElim = {"", "CSELdElim", "CSE redundant loads"};
+static StatsCounter CSEStore2Load = {"",
+                                     "CSEStore2Load",
+                                     "CSE forwarded store to load"};
+static StatsCounter CSEStElim = {"", "CSEStElim", "CSE redundant stores"};
+static StatsCounter CSEDeadIterations = {
+    "",
+    "CSEDeadIterations",
+    "CSE dead instructions found only after removing their users"};
+
+// The phase timers are shared by every function; when functions are optimized
+// on several threads only the whole pass is timed.
+static bool timeFunctionPhases() {
+  return TimePassesIsEnabled && Threads <= 1;
+}
+
+// Function-scoped analyses used by CSE. Each tree is computed the first time
+// it is requested for a function and reused until another function is
+// queried; CSE only erases non-terminators, so the trees stay valid while it
+// runs.
+class CSEAnalysisCache {
+public:
+  DominatorTree &getDomTree(Function &F) {
+    if (DTFunction != &F) {
+      NamedRegionTimer T("domtree",
+                         "Dominator Tree Construction",
+                         "p2",
+                         "p2 CSE",
+                         timeFunctionPhases());
+      DT.recalculate(F);
+      DTFunction = &F;
+    }
+    return DT;
+  }
+
+  PostDominatorTree &getPostDomTree(Function &F) {
+    if (PDTFunction != &F) {
+      NamedRegionTimer T("postdomtree",
+                         "Post-Dominator Tree Construction",
+                         "p2",
+                         "p2 CSE",
+                         timeFunctionPhases());
+      PDT.recalculate(F);
+      PDTFunction = &F;
+    }
+    return PDT;
+  }
+
+private:
+  DominatorTree DT;
+  Function *DTFunction = nullptr;
+  PostDominatorTree PDT;
+  Function *PDTFunction = nullptr;
+};
+
+// Key for the CSE value table. Two instructions land on the same entry when
+// they compute the same value: same opcode, type, flags and operands, where
+// the operands of commutative operations are put in a canonical order first.
+struct CSEValue {
+  Instruction *Inst;
+
+  CSEValue(Instruction *I) : Inst(I) {}
+};
+
+namespace llvm {
+template <> struct DenseMapInfo<CSEValue> {
+  static inline CSEValue getEmptyKey() {
+    return DenseMapInfo<Instruction *>::getEmptyKey();
+  }
+  static inline CSEValue getTombstoneKey() {
+    return DenseMapInfo<Instruction *>::getTombstoneKey();
+  }
+  static unsigned getHashValue(CSEValue Val);
+  static bool isEqual(CSEValue LHS, CSEValue RHS);
+};
+} // namespace llvm
+
+typedef RecyclingAllocator<BumpPtrAllocator,
+                           ScopedHashTableVal<CSEValue, Instruction *>>
+    CSEAllocator;
+typedef ScopedHashTable<CSEValue,
+                        Instruction *,
+                        DenseMapInfo<CSEValue>,
+                        CSEAllocator>
+    CSEValueTable;
+typedef ScopedHashTableScope<CSEValue,
+                             Instruction *,
+                             DenseMapInfo<CSEValue>,
+                             CSEAllocator>
+    CSEScope;
+
+// One step of the dominator tree walk. Creating it opens a scope in the value
+// table; destroying it drops every value the block and its children added.
+struct CSEStackNode {
+  CSEScope Scope;
+  DomTreeNode *Node;
+  DomTreeNode::const_iterator ChildIter;
+  bool Processed = false;
+
+  CSEStackNode(CSEValueTable &Values, DomTreeNode *N)
+      : Scope(Values), Node(N), ChildIter(N->begin()) {}
+};
 
 // Function Signatures
 bool isDead(Instruction &I);
-void basicCSEPass(BasicBlock::iterator &inputIterator);
+bool basicCSEPass(Instruction *I, CSEValueTable &Values);
 void eliminateRedundantLoads(LoadInst *loadInst,
                              BasicBlock::iterator &inputIterator);
 void eliminateRedundantStoreCall(Instruction *storeCall,
@@ -178,56 +427,313 @@ void printStats() {
   errs() << "CSE LdElim:\t" << CSELdElim << "\n";
   errs() << "CSE Store2Load:\t" << CSEStore2Load << "\n";
   errs() << "CSE StElim:\t" << CSEStElim << "\n";
+  errs() << "CSE Dead Iterations:\t" << CSEDeadIterations << "\n";
   errs() << "CSE Total:\t"
          << CSEDead + CSEElim + CSESimplify + CSELdElim + CSEStore2Load +
                 CSEStElim
          << "\n";
 }
-static void CommonSubexpressionElimination(Module *M) {
 
-  // Iterate over all instructions in the module
-  for (auto funcIter = M->begin(); funcIter != M->end(); funcIter++) {
-    for (auto blockIter = funcIter->begin(); blockIter != funcIter->end();
-         blockIter++) {
-      for (auto instIter = blockIter->begin(); instIter != blockIter->end();) {
-        Instruction *I = &*instIter;
-        auto tempIter = instIter;
-        // Dead code elimination
-        if (isDead(*I)) {
-          instIter++;
-          I->eraseFromParent();
-          CSEDead++;
+static void optimizeBasicBlock(BasicBlock &BB,
+                               CSEValueTable &Values,
+                               const DataLayout &DL) {
+  for (auto instIter = BB.begin(); instIter != BB.end();) {
+    Instruction *I = &*instIter;
+    auto tempIter = instIter;
+    // Dead code elimination
+    if (isDead(*I)) {
+      instIter++;
+      I->eraseFromParent();
+      CSEDead++;
+      continue;
+    }
+
+    // Simplify instructions
+    if (auto simplified = SimplifyInstruction(I, DL)) {
+      instIter++;
+      I->replaceAllUsesWith(simplified);
+      I->eraseFromParent();
+      CSESimplify++;
+      continue;
+    }
+
+    // Optimization 1: Common Subexpression Elimination
+    if (basicCSEPass(I, Values)) {
+      instIter++;
+      I->eraseFromParent();
+      CSEElim++;
+      continue;
+    }
+
+    // Optimization 2: Eliminate Redundant Loads
+    // (-cse-memssa handles loads and stores for the whole function instead)
+    if (I->getOpcode() == Instruction::Load && !CSEMemSSA) {
+      auto copyIterator = instIter;
+      LoadInst *loadInst = cast<LoadInst>(I);
+      eliminateRedundantLoads(loadInst, copyIterator);
+    }
+
+    // Optimization 3: Eliminate Redundant Stores
+    if (I->getOpcode() == Instruction::Store && !CSEMemSSA) {
+      eliminateRedundantStoreCall(I, instIter);
+    }
+
+    if (instIter == tempIter) {
+      instIter++;
+    }
+  }
+}
+
+// Worklist dead code elimination. Every instruction is checked once; when one
+// is erased its operands go back on the worklist since they may have just
+// lost their last use, so whole dead chains disappear in a single run.
+static void eliminateDeadCode(Function &F) {
+  SetVector<Instruction *> worklist;
+  for (auto &I : instructions(F)) {
+    worklist.insert(&I);
+  }
+
+  while (!worklist.empty()) {
+    Instruction *I = worklist.pop_back_val();
+    if (!isDead(*I)) {
+      continue;
+    }
+    for (Value *operand : I->operands()) {
+      if (auto *opInst = dyn_cast<Instruction>(operand)) {
+        worklist.insert(opInst);
+      }
+    }
+    I->eraseFromParent();
+    CSEDead++;
+    CSEDeadIterations++;
+  }
+}
+
+// Memory state and alias queries for eliminateRedundantMemoryOps. BasicAA is
+// the only alias analysis; it is enough to tell apart distinct allocas,
+// globals and constant offsets from the same base.
+struct CSEMemoryAnalyses {
+  TargetLibraryInfoImpl TLII;
+  TargetLibraryInfo TLI;
+  AssumptionCache AC;
+  BasicAAResult BasicAA;
+  AAResults AA;
+  std::unique_ptr<MemorySSA> MSSA;
+  std::unique_ptr<MemorySSAUpdater> Updater;
+
+  CSEMemoryAnalyses(Function &F, DominatorTree &DT)
+      : TLII(Triple(F.getParent()->getTargetTriple())),
+        TLI(TLII),
+        AC(F),
+        BasicAA(F.getParent()->getDataLayout(), F, TLI, AC, &DT),
+        AA(TLI) {
+    AA.addAAResult(BasicAA);
+    MSSA = std::make_unique<MemorySSA>(F, &AA, &DT);
+    Updater = std::make_unique<MemorySSAUpdater>(MSSA.get());
+  }
+};
+
+static void eraseMemoryInst(Instruction *I, CSEMemoryAnalyses &Mem) {
+  Mem.Updater->removeMemoryAccess(I);
+  I->eraseFromParent();
+}
+
+// A load is redundant if the nearest write that may clobber its address is a
+// store to exactly that address (forward the stored value), or if a load of
+// the same address and type with the same clobbering write dominates it.
+static void eliminateRedundantLoadsMemSSA(DominatorTree &DT,
+                                          CSEMemoryAnalyses &Mem) {
+  MemorySSAWalker *Walker = Mem.MSSA->getWalker();
+  DenseMap<std::tuple<MemoryAccess *, Value *, Type *>, LoadInst *> Available;
+
+  for (DomTreeNode *Node : depth_first(DT.getRootNode())) {
+    BasicBlock *BB = Node->getBlock();
+    for (auto instIter = BB->begin(); instIter != BB->end();) {
+      auto *Load = dyn_cast<LoadInst>(&*instIter++);
+      if (!Load || !Load->isSimple()) {
+        continue;
+      }
+
+      MemoryAccess *Clobber = Walker->getClobberingMemoryAccess(Load);
+      if (auto *Def = dyn_cast<MemoryDef>(Clobber)) {
+        auto *Store = dyn_cast_or_null<StoreInst>(Def->getMemoryInst());
+        if (Store && Store->isSimple() &&
+            Store->getValueOperand()->getType() == Load->getType() &&
+            Mem.AA.isMustAlias(MemoryLocation::get(Store),
+                               MemoryLocation::get(Load))) {
+          Load->replaceAllUsesWith(Store->getValueOperand());
+          eraseMemoryInst(Load, Mem);
+          CSEStore2Load++;
           continue;
         }
+      }
+
+      auto Key =
+          std::make_tuple(Clobber, Load->getPointerOperand(), Load->getType());
+      auto Found = Available.find(Key);
+      if (Found != Available.end() && DT.dominates(Found->second, Load)) {
+        Load->replaceAllUsesWith(Found->second);
+        eraseMemoryInst(Load, Mem);
+        CSELdElim++;
+        continue;
+      }
+      Available[Key] = Load;
+    }
+  }
+}
+
+// A store is dead if every path from it reaches a store that overwrites the
+// same location before anything can read it. The overwriting store must
+// post-dominate it, and no reader may be reachable through the MemorySSA
+// def-use chains in between.
+static bool isDeadStore(StoreInst *Store,
+                        PostDominatorTree &PDT,
+                        CSEMemoryAnalyses &Mem) {
+  MemoryLocation Loc = MemoryLocation::get(Store);
+  MemoryAccess *StoreAccess = Mem.MSSA->getMemoryAccess(Store);
+  SmallVector<MemoryAccess *, 16> worklist = {StoreAccess};
+  SmallPtrSet<MemoryAccess *, 16> visited;
+  bool killed = false;
 
-        // Simplify instructions
-        if (auto simplified = SimplifyInstruction(I, M->getDataLayout())) {
-          instIter++;
-          I->replaceAllUsesWith(simplified);
-          I->eraseFromParent();
-          CSESimplify++;
+  while (!worklist.empty()) {
+    MemoryAccess *Access = worklist.pop_back_val();
+    for (User *U : Access->users()) {
+      if (U == StoreAccess) {
+        // Reaching the store again means it is in a loop
+        return false;
+      }
+      if (auto *UseOrDef = dyn_cast<MemoryUseOrDef>(U)) {
+        Instruction *I = UseOrDef->getMemoryInst();
+        auto *Later = dyn_cast<StoreInst>(I);
+        if (Later && Later->isSimple() &&
+            Later->getValueOperand()->getType() ==
+                Store->getValueOperand()->getType() &&
+            Mem.AA.isMustAlias(MemoryLocation::get(Later), Loc)) {
+          if (!PDT.dominates(Later, Store)) {
+            return false;
+          }
+          killed = true;
           continue;
         }
+        if (isRefSet(Mem.AA.getModRefInfo(I, Loc))) {
+          return false;
+        }
+      }
+      if (!isa<MemoryUse>(U) && visited.insert(cast<MemoryAccess>(U)).second) {
+        worklist.push_back(cast<MemoryAccess>(U));
+      }
+    }
+  }
+  return killed;
+}
+
+static void eliminateDeadStoresMemSSA(Function &F,
+                                      PostDominatorTree &PDT,
+                                      CSEMemoryAnalyses &Mem) {
+  // If the function can unwind, a store to memory the caller can see is
+  // observable even when it is overwritten later in this function
+  bool mayUnwind = false;
+  SmallVector<StoreInst *, 32> stores;
+  for (auto &I : instructions(F)) {
+    mayUnwind = mayUnwind || I.mayThrow();
+    if (auto *Store = dyn_cast<StoreInst>(&I)) {
+      if (Store->isSimple()) {
+        stores.push_back(Store);
+      }
+    }
+  }
 
-        // Optimization 1: Common Subexpression Elimination
-        auto copyIterator = instIter;
-        basicCSEPass(copyIterator);
+  for (StoreInst *Store : stores) {
+    if (mayUnwind &&
+        !isa<AllocaInst>(getUnderlyingObject(Store->getPointerOperand()))) {
+      continue;
+    }
+    if (isDeadStore(Store, PDT, Mem)) {
+      eraseMemoryInst(Store, Mem);
+      CSEStElim++;
+    }
+  }
+}
 
-        // Optimization 2: Eliminate Redundant Loads
-        if (I->getOpcode() == Instruction::Load) {
-          auto copyIterator = instIter;
-          LoadInst *loadInst = cast<LoadInst>(I);
-          eliminateRedundantLoads(loadInst, copyIterator);
-        }
+static void eliminateRedundantMemoryOps(Function &F,
+                                        DominatorTree &DT,
+                                        PostDominatorTree &PDT) {
+  NamedRegionTimer T("memssa",
+                     "MemorySSA Load/Store Elimination",
+                     "p2",
+                     "p2 CSE",
+                     timeFunctionPhases());
+  CSEMemoryAnalyses Mem(F, DT);
+  eliminateRedundantLoadsMemSSA(DT, Mem);
+  eliminateDeadStoresMemSSA(F, PDT, Mem);
+}
 
-        // Optimization 3: Eliminate Redundant Stores
-        if (I->getOpcode() == Instruction::Store) {
-          eliminateRedundantStoreCall(I, instIter);
-        }
+static void CommonSubexpressionElimination(Function &F,
+                                           CSEAnalysisCache &Analyses) {
+  StatsScope Scope("cse", &F);
+  const DataLayout &DL = F.getParent()->getDataLayout();
 
-        if (instIter == tempIter) {
-          instIter++;
-        }
+  // CSE only rewrites and erases non-terminators, so the CFG (and with it
+  // the dominator tree) stays valid for the whole function.
+  DominatorTree &DT = Analyses.getDomTree(F);
+
+  // Memory operations go first so the walk below can simplify and CSE
+  // whatever used the removed loads
+  if (CSEMemSSA) {
+    eliminateRedundantMemoryOps(F, DT, Analyses.getPostDomTree(F));
+  }
+
+  CSEValueTable Values;
+
+  // Visit blocks in dominator tree preorder. A value in the table is
+  // available in every block below the one that defined it.
+  std::vector<std::unique_ptr<CSEStackNode>> Stack;
+  Stack.push_back(std::make_unique<CSEStackNode>(Values, DT.getRootNode()));
+  while (!Stack.empty()) {
+    CSEStackNode *Top = Stack.back().get();
+    if (!Top->Processed) {
+      optimizeBasicBlock(*Top->Node->getBlock(), Values, DL);
+      Top->Processed = true;
+    } else if (Top->ChildIter != Top->Node->end()) {
+      DomTreeNode *Child = *Top->ChildIter++;
+      Stack.push_back(std::make_unique<CSEStackNode>(Values, Child));
+    } else {
+      Stack.pop_back();
+    }
+  }
+
+  // Unreachable blocks are not in the tree; give each one its own scope
+  for (auto &BB : F) {
+    if (!DT.isReachableFromEntry(&BB)) {
+      CSEScope Scope(Values);
+      optimizeBasicBlock(BB, Values, DL);
+    }
+  }
+
+  // The value table is empty again, so erasing is safe now. This removes
+  // what CSE, simplification and load forwarding left without uses.
+  eliminateDeadCode(F);
+}
+
+static void CommonSubexpressionElimination(Module *M) {
+  NamedRegionTimer T("cse",
+                     "Common Subexpression Elimination",
+                     "p2",
+                     "p2 CSE",
+                     TimePassesIsEnabled);
+  StatsScope Scope("cse");
+
+  if (Threads > 1) {
+    optimizeFunctionsInParallel(*M, Threads, [](Function &F) {
+      CSEAnalysisCache Analyses;
+      CommonSubexpressionElimination(F, Analyses);
+    });
+  } else {
+    CSEAnalysisCache Analyses;
+    for (auto &F : *M) {
+      if (!F.isDeclaration()) {
+        CommonSubexpressionElimination(F, Analyses);
+        renameInProgramOrder(F);
       }
     }
   }
@@ -236,6 +742,47 @@ static void CommonSubexpressionElimination(Module *M) {
   printStats();
 }
 
+// -lazy: function bodies are read from the bitcode one at a time, and each
+// goes through mem2reg and CSE as soon as it is loaded. Functions shrink as
+// they are optimized, so the module never holds every body in its
+// unoptimized form at once. The result is the same as with the whole module
+// loaded up front.
+static void optimizeLazily(Module &M) {
+  legacy::FunctionPassManager Passes(&M);
+  if (Mem2Reg) {
+    Passes.add(createPromoteMemoryToRegisterPass());
+  }
+  Passes.doInitialization();
+
+  CSEAnalysisCache Analyses;
+  for (auto &F : M) {
+    if (Error E = F.materialize()) {
+      report_fatal_error(std::move(E));
+    }
+    if (F.isDeclaration()) {
+      continue;
+    }
+    if (Mem2Reg) {
+      StatsScope Scope("mem2reg", &F);
+      Passes.run(F);
+    }
+    if (!NoCSE) {
+      CommonSubexpressionElimination(F, Analyses);
+      renameInProgramOrder(F);
+    }
+  }
+
+  Passes.doFinalization();
+  // Whatever the functions did not pull in, such as metadata they do not use
+  if (Error E = M.materializeAll()) {
+    report_fatal_error(std::move(E));
+  }
+
+  if (!NoCSE) {
+    printStats();
+  }
+}
+
 // Implementation
 
 bool shouldCSEworkOnInstruction(Instruction *I) {
@@ -252,10 +799,18 @@ bool shouldCSEworkOnInstruction(Instruction *I) {
   case Instruction::CallBr:
   case Instruction::Alloca:
   case Instruction::FCmp:
+  // A phi can take a value from a block visited later, so its operands (and
+  // with them its key in the value table) may still change
+  case Instruction::PHI:
     return false;
   default:
     break;
   }
+  // Anything else that touches memory or has side effects is not a pure
+  // function of its operands
+  if (I->mayReadOrWriteMemory() || I->mayHaveSideEffects()) {
+    return false;
+  }
   return true;
 }
 
@@ -329,6 +884,9 @@ bool isDead(Instruction &I) {
     case Instruction::ExtractValue:
     case Instruction::InsertValue:
       return true; // dead, but this is not enough
+    case Instruction::Load:
+      // Volatile and atomic loads must stay even when unused
+      return cast<LoadInst>(&I)->isSimple();
     default:
       // any other opcode fails
       return false;
@@ -337,53 +895,74 @@ bool isDead(Instruction &I) {
   return false;
 }
 
-void removeCommonInstructionsIn(BasicBlock::iterator iterator,
-                                BasicBlock *bb,
-                                Instruction *I) {
-  for (auto instIter = iterator; instIter != bb->end();) {
-    Instruction *nextInstruction = &*instIter;
-    instIter++;
-    if (I != nextInstruction && I->isIdenticalTo(nextInstruction)) {
-      nextInstruction->replaceAllUsesWith(I);
-      nextInstruction->eraseFromParent();
-      CSEElim++;
+unsigned DenseMapInfo<CSEValue>::getHashValue(CSEValue Val) {
+  Instruction *I = Val.Inst;
+  if (auto *BinOp = dyn_cast<BinaryOperator>(I)) {
+    Value *LHS = BinOp->getOperand(0);
+    Value *RHS = BinOp->getOperand(1);
+    if (BinOp->isCommutative() && LHS > RHS) {
+      std::swap(LHS, RHS);
     }
+    return hash_combine(I->getOpcode(), I->getType(), LHS, RHS);
   }
+  if (auto *Cmp = dyn_cast<CmpInst>(I)) {
+    Value *LHS = Cmp->getOperand(0);
+    Value *RHS = Cmp->getOperand(1);
+    CmpInst::Predicate Pred = Cmp->getPredicate();
+    if (LHS > RHS) {
+      std::swap(LHS, RHS);
+      Pred = Cmp->getSwappedPredicate();
+    }
+    return hash_combine(I->getOpcode(), I->getType(), Pred, LHS, RHS);
+  }
+  return hash_combine(
+      I->getOpcode(),
+      I->getType(),
+      hash_combine_range(I->value_op_begin(), I->value_op_end()));
 }
 
-DomTreeNodeBase<BasicBlock> *getDomTree(Instruction *I) {
-  auto *bb = I->getParent();
-  auto *F = bb->getParent();
-  DominatorTreeBase<BasicBlock, false> *DT =
-      new DominatorTreeBase<BasicBlock, false>();
-  DT->recalculate(*F); // F is Function*. Use one DominatorTreeBase and
-                       // recalculate tree for each function you visit
-  DomTreeNodeBase<BasicBlock> *Node =
-      DT->getNode(bb); // get Node from some basic block*
-  return Node;
-}
-
-void removeCommonInstInDominatedBlocks(Instruction *I) {
-  auto *Node = getDomTree(I);
-  DomTreeNodeBase<BasicBlock>::iterator it, end;
-  for (it = Node->begin(), end = Node->end(); it != end; it++) {
-    BasicBlock *bb_next =
-        (*it)->getBlock(); // get each bb it immediately adominates
-                           // Iterate over all instructions in bb_next
-    removeCommonInstructionsIn(bb_next->begin(), bb_next, I);
+bool DenseMapInfo<CSEValue>::isEqual(CSEValue LHS, CSEValue RHS) {
+  Instruction *I1 = LHS.Inst;
+  Instruction *I2 = RHS.Inst;
+  if (I1 == getEmptyKey().Inst || I1 == getTombstoneKey().Inst ||
+      I2 == getEmptyKey().Inst || I2 == getTombstoneKey().Inst) {
+    return I1 == I2;
+  }
+  if (I1->isIdenticalTo(I2)) {
+    return true;
+  }
+  if (I1->getOpcode() != I2->getOpcode() || I1->getType() != I2->getType() ||
+      I1->getRawSubclassOptionalData() != I2->getRawSubclassOptionalData()) {
+    return false;
+  }
+  // Same operation with the operands swapped
+  if (auto *BinOp = dyn_cast<BinaryOperator>(I1)) {
+    return BinOp->isCommutative() &&
+           I1->getOperand(0) == I2->getOperand(1) &&
+           I1->getOperand(1) == I2->getOperand(0);
   }
+  if (auto *Cmp = dyn_cast<CmpInst>(I1)) {
+    return Cmp->getSwappedPredicate() == cast<CmpInst>(I2)->getPredicate() &&
+           I1->getOperand(0) == I2->getOperand(1) &&
+           I1->getOperand(1) == I2->getOperand(0);
+  }
+  return false;
 }
 
-// Function which takes Instruction and returns a string
-void basicCSEPass(BasicBlock::iterator &inputIterator) {
-  auto *I = &*inputIterator;
+// Look I up among the values available at this point of the dominator tree
+// walk. Returns true if an equivalent value was found and I's uses were
+// redirected to it; the caller is responsible for erasing I.
+bool basicCSEPass(Instruction *I, CSEValueTable &Values) {
   // Defensive checks, Early exit
-  if (shouldCSEworkOnInstruction(I)) {
-    // Remove common instructions in the same basic block
-    removeCommonInstructionsIn(inputIterator, I->getParent(), I);
-    // Remove common instructions in the same function, next block
-    removeCommonInstInDominatedBlocks(I);
+  if (!shouldCSEworkOnInstruction(I)) {
+    return false;
   }
+  if (Instruction *Available = Values.lookup(I)) {
+    I->replaceAllUsesWith(Available);
+    return true;
+  }
+  Values.insert(I, I);
+  return false;
 }
 
 bool isCall(Instruction *I) {
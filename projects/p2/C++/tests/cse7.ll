@@ -0,0 +1,38 @@
+; ModuleID = 'cse7'
+; CHECK-LABEL: source_filename = "cse7"
+source_filename = "cse7"
+
+; CHECK-LABEL: @cse7(i32 %0, i32 %1)
+define i32 @cse7(i32 %0, i32 %1) {
+; CHECK-NEXT: BB:
+; CHECK-NEXT: add i32 %0, %1
+; CHECK-NEXT: icmp sgt i32 %0, %1
+; CHECK-NEXT: br i1
+BB:
+  %A = add i32 %0, %1
+  %C = icmp sgt i32 %0, %1
+  br i1 %C, label %BB1, label %BB3
+
+; CHECK: BB1:
+; CHECK-NEXT: br label %BB2
+BB1:
+  br label %BB2
+
+; CHECK: BB2:
+; CHECK-NEXT: mul i32 %A, %A
+; CHECK-NEXT: select i1 %C
+; CHECK-NEXT: br label %BB3
+BB2:
+  %A1 = add i32 %1, %0
+  %C1 = icmp slt i32 %1, %0
+  %M = mul i32 %A1, %A
+  %S = select i1 %C1, i32 %M, i32 %1
+  br label %BB3
+
+; CHECK: BB3:
+; CHECK-NEXT: phi
+; CHECK-NEXT: ret i32
+BB3:
+  %P = phi i32 [ %A, %BB ], [ %S, %BB2 ]
+  ret i32 %P
+}
@@ -0,0 +1,20 @@
+; ModuleID = 'cse8'
+; CHECK-LABEL: source_filename = "cse8"
+source_filename = "cse8"
+
+; A dead chain only becomes dead from the bottom up, so it has to be removed
+; in one run of the tool.
+; CHECK-LABEL: @cse8(i32* %0, i32 %1)
+define i32 @cse8(i32* %0, i32 %1) {
+; CHECK-NEXT: BB:
+; CHECK-NEXT: load volatile
+; CHECK-NEXT: ret i32 %1
+BB:
+  %L = load i32, i32* %0, align 4
+  %A = add i32 %L, %1
+  %M = mul i32 %A, %A
+  %X = xor i32 %M, %L
+  %V = load volatile i32, i32* %0, align 4
+  %S = sub i32 %X, %V
+  ret i32 %1
+}
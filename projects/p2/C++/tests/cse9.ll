@@ -0,0 +1,44 @@
+; ModuleID = 'cse9'
+; CHECK-LABEL: source_filename = "cse9"
+source_filename = "cse9"
+
+; Loads and stores across blocks and past stores to other allocas; only
+; removed with -cse-memssa.
+; CHECK-LABEL: @cse9(i32 %0, i32 %1, i1 %2)
+define i32 @cse9(i32 %0, i32 %1, i1 %2) {
+; CHECK-NEXT: BB:
+; CHECK-NEXT: alloca
+; CHECK-NEXT: alloca
+; CHECK-NEXT: store i32 %1, i32* %B
+; CHECK-NEXT: br i1
+BB:
+  %A = alloca i32, align 4
+  %B = alloca i32, align 4
+  store i32 %0, i32* %A, align 4
+  store i32 %1, i32* %B, align 4
+  br i1 %2, label %BB1, label %BB2
+
+; CHECK: BB1:
+; CHECK-NEXT: br label %BB3
+BB1:
+  %L = load i32, i32* %B, align 4
+  br label %BB3
+
+; CHECK: BB2:
+; CHECK-NEXT: br label %BB3
+BB2:
+  br label %BB3
+
+; CHECK: BB3:
+; CHECK-NEXT: phi i32 [ %1, %BB1 ], [ 0, %BB2 ]
+; CHECK-NEXT: store i32 %P, i32* %A
+; CHECK-NEXT: add i32 %P, %1
+; CHECK-NEXT: ret i32
+BB3:
+  %P = phi i32 [ %L, %BB1 ], [ 0, %BB2 ]
+  store i32 %P, i32* %A, align 4
+  %L2 = load i32, i32* %A, align 4
+  %L3 = load i32, i32* %B, align 4
+  %S = add i32 %L2, %L3
+  ret i32 %S
+}
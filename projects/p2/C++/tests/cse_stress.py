@@ -0,0 +1,53 @@
+#!/usr/bin/env python3
+#
+# Emit a synthetic single-function module for timing CSE.
+#
+# usage: cse_stress.py <instructions> [diamonds]
+#
+# The function is a chain of if/else diamonds. Every block recomputes a
+# window of the expressions from its dominators (half of them with the
+# operands commuted), so the amount of redundancy grows with the size of
+# the function and a pass that only compares within a block or one level
+# down the dominator tree does quadratic work without finding most of it.
+
+import sys
+
+ninsts = int(sys.argv[1]) if len(sys.argv) > 1 else 100000
+ndiamonds = int(sys.argv[2]) if len(sys.argv) > 2 else max(1, ninsts // 300)
+# three blocks per diamond, three instructions per expression
+per_block = max(1, ninsts // ndiamonds // 9)
+ops = ["add", "mul", "xor", "and", "or"]
+
+print("; ModuleID = 'cse_stress'")
+print("source_filename = \"cse_stress\"")
+print()
+print("define i32 @cse_stress(i32 %a, i32 %b, i32* %p) {")
+print("entry:")
+print("  br label %d0")
+
+val = 0
+def emit(k):
+    global val
+    op = ops[k % len(ops)]
+    lhs, rhs = ("%a", "%b") if (k // len(ops)) % 2 == 0 else ("%b", "%a")
+    print("  %%v%d = %s i32 %s, %s" % (val, op, lhs, rhs))
+    print("  %%w%d = %s i32 %%v%d, %d" % (val, op, val, k))
+    print("  store i32 %%w%d, i32* %%p" % val)
+    val += 1
+
+for d in range(ndiamonds):
+    nxt = "d%d" % (d + 1) if d + 1 < ndiamonds else "exit"
+    print("d%d:" % d)
+    for k in range(per_block):
+        emit(k + d)
+    print("  %%c%d = icmp ult i32 %%a, %d" % (d, d))
+    print("  br i1 %%c%d, label %%t%d, label %%f%d" % (d, d, d))
+    for side in ("t", "f"):
+        print("%s%d:" % (side, d))
+        for k in range(per_block):
+            emit(k + d + 1)
+        print("  br label %%%s" % nxt)
+
+print("exit:")
+print("  ret i32 0")
+print("}")
@@ -0,0 +1,275 @@
+/*
+ * File: analysis.cpp
+ *
+ * Description:
+ *   A per-function cache of the dominance and loop analyses behind the C
+ *   interface in dominance.h
+ */
+
+#include <list>
+#include <memory>
+
+/* LLVM Header Files */
+#include "llvm-c/Core.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/PostDominators.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Function.h"
+#include "llvm/Support/CBindingWrapping.h"
+
+#include "analysis.h"
+
+using namespace llvm;
+
+namespace {
+
+struct FunctionAnalyses {
+  std::unique_ptr<DominatorTree> DT;
+  std::unique_ptr<PostDominatorTree> PDT;
+  std::unique_ptr<LoopInfo> LI;
+};
+
+class AnalysisCache {
+public:
+  explicit AnalysisCache(unsigned Capacity)
+      : Capacity(Capacity ? Capacity : 1) {}
+
+  DominatorTree &getDomTree(Function *F) {
+    FunctionAnalyses &A = lookup(F);
+    if (!A.DT)
+      A.DT.reset(new DominatorTree(*F));
+    return *A.DT;
+  }
+
+  PostDominatorTree &getPostDomTree(Function *F) {
+    FunctionAnalyses &A = lookup(F);
+    if (!A.PDT)
+      A.PDT.reset(new PostDominatorTree(*F));
+    return *A.PDT;
+  }
+
+  LoopInfo &getLoopInfo(Function *F) {
+    FunctionAnalyses &A = lookup(F);
+    if (!A.LI)
+      A.LI.reset(new LoopInfo(getDomTree(F)));
+    return *A.LI;
+  }
+
+  void invalidate(Function *F) {
+    auto It = Entries.find(F);
+    if (It == Entries.end())
+      return;
+    Recent.erase(It->second);
+    Entries.erase(It);
+  }
+
+  void invalidateAll() {
+    Entries.clear();
+    Recent.clear();
+  }
+
+private:
+  typedef std::list<std::pair<Function *, FunctionAnalyses>> RecentList;
+
+  // Finds F's entry and marks it most recently used, evicting the least
+  // recently used function if a new entry does not fit
+  FunctionAnalyses &lookup(Function *F) {
+    auto It = Entries.find(F);
+    if (It != Entries.end()) {
+      Recent.splice(Recent.begin(), Recent, It->second);
+      return It->second->second;
+    }
+    if (Recent.size() >= Capacity) {
+      Entries.erase(Recent.back().first);
+      Recent.pop_back();
+    }
+    Recent.emplace_front(F, FunctionAnalyses());
+    Entries[F] = Recent.begin();
+    return Recent.front().second;
+  }
+
+  unsigned Capacity;
+  RecentList Recent;
+  DenseMap<Function *, RecentList::iterator> Entries;
+};
+
+// A position among the children of a dominator tree node
+struct DomChildCursor {
+  DomTreeNode::const_iterator Cur, End;
+
+  DomChildCursor(DomTreeNode::const_iterator Begin,
+                 DomTreeNode::const_iterator End)
+      : Cur(Begin), End(End) {}
+
+  BasicBlock *next() {
+    if (Cur == End)
+      return NULL;
+    return (*Cur++)->getBlock();
+  }
+};
+
+} // namespace
+
+DEFINE_SIMPLE_CONVERSION_FUNCTIONS(AnalysisCache, LLVMAnalysisCacheRef)
+DEFINE_SIMPLE_CONVERSION_FUNCTIONS(DomChildCursor, LLVMDomChildIteratorRef)
+
+static Function *parentOf(LLVMBasicBlockRef BB) {
+  return unwrap(BB)->getParent();
+}
+
+LLVMAnalysisCacheRef LLVMCreateAnalysisCache(unsigned Capacity)
+{
+  return wrap(new AnalysisCache(Capacity));
+}
+
+void LLVMDisposeAnalysisCache(LLVMAnalysisCacheRef C)
+{
+  delete unwrap(C);
+}
+
+void LLVMAnalysisCacheInvalidate(LLVMAnalysisCacheRef C, LLVMValueRef Fun)
+{
+  unwrap(C)->invalidate(unwrap<Function>(Fun));
+}
+
+void LLVMAnalysisCacheInvalidateAll(LLVMAnalysisCacheRef C)
+{
+  unwrap(C)->invalidateAll();
+}
+
+LLVMAnalysisCacheRef LLVMGetGlobalAnalysisCache(void)
+{
+  static AnalysisCache Global(8);
+  return wrap(&Global);
+}
+
+LLVMBool LLVMAnalysisCacheDominates(LLVMAnalysisCacheRef C, LLVMBasicBlockRef A,
+                                    LLVMBasicBlockRef B)
+{
+  DominatorTree &DT = unwrap(C)->getDomTree(parentOf(A));
+  return DT.dominates(unwrap(A), unwrap(B));
+}
+
+LLVMBool LLVMAnalysisCachePostDominates(LLVMAnalysisCacheRef C,
+                                        LLVMBasicBlockRef A,
+                                        LLVMBasicBlockRef B)
+{
+  PostDominatorTree &PDT = unwrap(C)->getPostDomTree(parentOf(A));
+  return PDT.dominates(unwrap(A), unwrap(B));
+}
+
+LLVMBool LLVMAnalysisCacheIsReachableFromEntry(LLVMAnalysisCacheRef C,
+                                               LLVMBasicBlockRef BB)
+{
+  DominatorTree &DT = unwrap(C)->getDomTree(parentOf(BB));
+  return DT.isReachableFromEntry(unwrap(BB));
+}
+
+LLVMBasicBlockRef LLVMAnalysisCacheImmDom(LLVMAnalysisCacheRef C,
+                                          LLVMBasicBlockRef BB)
+{
+  DominatorTree &DT = unwrap(C)->getDomTree(parentOf(BB));
+  DomTreeNode *Node = DT.getNode(unwrap(BB));
+  if (Node == NULL || Node->getIDom() == NULL)
+    return NULL;
+  return wrap(Node->getIDom()->getBlock());
+}
+
+LLVMBasicBlockRef LLVMAnalysisCacheImmPostDom(LLVMAnalysisCacheRef C,
+                                              LLVMBasicBlockRef BB)
+{
+  PostDominatorTree &PDT = unwrap(C)->getPostDomTree(parentOf(BB));
+  DomTreeNode *Node = PDT.getNode(unwrap(BB));
+  // The virtual root that joins several exits has no block
+  if (Node == NULL || Node->getIDom() == NULL)
+    return NULL;
+  return wrap(Node->getIDom()->getBlock());
+}
+
+LLVMBasicBlockRef LLVMAnalysisCacheNearestCommonDominator(
+    LLVMAnalysisCacheRef C, LLVMBasicBlockRef A, LLVMBasicBlockRef B)
+{
+  DominatorTree &DT = unwrap(C)->getDomTree(parentOf(A));
+  return wrap(DT.findNearestCommonDominator(unwrap(A), unwrap(B)));
+}
+
+LLVMBasicBlockRef LLVMAnalysisCacheFirstDomChild(LLVMAnalysisCacheRef C,
+                                                 LLVMBasicBlockRef BB)
+{
+  DominatorTree &DT = unwrap(C)->getDomTree(parentOf(BB));
+  DomTreeNode *Node = DT.getNode(unwrap(BB));
+  if (Node == NULL || Node->begin() == Node->end())
+    return NULL;
+  return wrap((*Node->begin())->getBlock());
+}
+
+LLVMBasicBlockRef LLVMAnalysisCacheNextDomChild(LLVMAnalysisCacheRef C,
+                                                LLVMBasicBlockRef BB,
+                                                LLVMBasicBlockRef Child)
+{
+  DominatorTree &DT = unwrap(C)->getDomTree(parentOf(BB));
+  DomTreeNode *Node = DT.getNode(unwrap(BB));
+  if (Node == NULL)
+    return NULL;
+
+  DomTreeNode *ChildNode = DT.getNode(unwrap(Child));
+  bool next = false;
+  for (DomTreeNode *N : *Node) {
+    if (next)
+      return wrap(N->getBlock());
+    if (N == ChildNode)
+      next = true;
+  }
+  return NULL;
+}
+
+LLVMDomChildIteratorRef
+LLVMAnalysisCacheCreateDomChildIterator(LLVMAnalysisCacheRef C,
+                                        LLVMBasicBlockRef BB)
+{
+  DominatorTree &DT = unwrap(C)->getDomTree(parentOf(BB));
+  DomTreeNode *Node = DT.getNode(unwrap(BB));
+  if (Node == NULL)
+    return wrap(new DomChildCursor(DomTreeNode::const_iterator(),
+                                   DomTreeNode::const_iterator()));
+  return wrap(new DomChildCursor(Node->begin(), Node->end()));
+}
+
+LLVMBasicBlockRef LLVMDomChildIteratorNext(LLVMDomChildIteratorRef It)
+{
+  return wrap(unwrap(It)->next());
+}
+
+void LLVMDisposeDomChildIterator(LLVMDomChildIteratorRef It)
+{
+  delete unwrap(It);
+}
+
+unsigned LLVMAnalysisCacheCountDomChildren(LLVMAnalysisCacheRef C,
+                                           LLVMBasicBlockRef BB)
+{
+  DominatorTree &DT = unwrap(C)->getDomTree(parentOf(BB));
+  DomTreeNode *Node = DT.getNode(unwrap(BB));
+  return Node == NULL ? 0 : Node->getNumChildren();
+}
+
+void LLVMAnalysisCacheGetDomChildren(LLVMAnalysisCacheRef C,
+                                     LLVMBasicBlockRef BB,
+                                     LLVMBasicBlockRef *Children)
+{
+  DominatorTree &DT = unwrap(C)->getDomTree(parentOf(BB));
+  DomTreeNode *Node = DT.getNode(unwrap(BB));
+  if (Node == NULL)
+    return;
+  for (DomTreeNode *Child : *Node)
+    *Children++ = wrap(Child->getBlock());
+}
+
+unsigned LLVMAnalysisCacheLoopDepth(LLVMAnalysisCacheRef C,
+                                    LLVMBasicBlockRef BB)
+{
+  LoopInfo &LI = unwrap(C)->getLoopInfo(parentOf(BB));
+  return LI.getLoopDepth(unwrap(BB));
+}
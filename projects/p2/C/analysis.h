@@ -0,0 +1,76 @@
+#ifndef ANALYSIS_H
+#define ANALYSIS_H
+
+#include "llvm-c/Core.h"
+#include "llvm-c/DataTypes.h"
+#include "llvm-c/ExternC.h"
+
+LLVM_C_EXTERN_C_BEGIN
+
+/*
+ * A cache of the dominator tree, post-dominator tree and loop info of
+ * recently queried functions. Each analysis is computed the first time it is
+ * asked for and kept until the function is invalidated or evicted; at most
+ * Capacity functions are kept, dropping the least recently used first.
+ *
+ * Nothing notices when a function is changed or deleted: call
+ * LLVMAnalysisCacheInvalidate after editing its CFG.
+ */
+typedef struct LLVMOpaqueAnalysisCache *LLVMAnalysisCacheRef;
+
+LLVMAnalysisCacheRef LLVMCreateAnalysisCache(unsigned Capacity);
+void LLVMDisposeAnalysisCache(LLVMAnalysisCacheRef C);
+
+/* Forget the analyses of one function, or of all of them */
+void LLVMAnalysisCacheInvalidate(LLVMAnalysisCacheRef C, LLVMValueRef Fun);
+void LLVMAnalysisCacheInvalidateAll(LLVMAnalysisCacheRef C);
+
+/* The cache behind the queries in dominance.h */
+LLVMAnalysisCacheRef LLVMGetGlobalAnalysisCache(void);
+
+LLVMBool LLVMAnalysisCacheDominates(LLVMAnalysisCacheRef C, LLVMBasicBlockRef A,
+                                    LLVMBasicBlockRef B);
+LLVMBool LLVMAnalysisCachePostDominates(LLVMAnalysisCacheRef C,
+                                        LLVMBasicBlockRef A,
+                                        LLVMBasicBlockRef B);
+LLVMBool LLVMAnalysisCacheIsReachableFromEntry(LLVMAnalysisCacheRef C,
+                                               LLVMBasicBlockRef BB);
+
+LLVMBasicBlockRef LLVMAnalysisCacheImmDom(LLVMAnalysisCacheRef C,
+                                          LLVMBasicBlockRef BB);
+LLVMBasicBlockRef LLVMAnalysisCacheImmPostDom(LLVMAnalysisCacheRef C,
+                                              LLVMBasicBlockRef BB);
+LLVMBasicBlockRef LLVMAnalysisCacheNearestCommonDominator(
+    LLVMAnalysisCacheRef C, LLVMBasicBlockRef A, LLVMBasicBlockRef B);
+
+LLVMBasicBlockRef LLVMAnalysisCacheFirstDomChild(LLVMAnalysisCacheRef C,
+                                                 LLVMBasicBlockRef BB);
+LLVMBasicBlockRef LLVMAnalysisCacheNextDomChild(LLVMAnalysisCacheRef C,
+                                                LLVMBasicBlockRef BB,
+                                                LLVMBasicBlockRef Child);
+
+/* Step through the children of BB in the dominator tree in constant time
+   per child; Next returns NULL after the last one. The cursor walks the
+   cached tree, so it must be disposed of before BB's function is invalidated
+   or evicted. */
+typedef struct LLVMOpaqueDomChildIterator *LLVMDomChildIteratorRef;
+
+LLVMDomChildIteratorRef
+LLVMAnalysisCacheCreateDomChildIterator(LLVMAnalysisCacheRef C,
+                                        LLVMBasicBlockRef BB);
+LLVMBasicBlockRef LLVMDomChildIteratorNext(LLVMDomChildIteratorRef It);
+void LLVMDisposeDomChildIterator(LLVMDomChildIteratorRef It);
+
+/* Fill an array of LLVMAnalysisCacheCountDomChildren entries in one call */
+unsigned LLVMAnalysisCacheCountDomChildren(LLVMAnalysisCacheRef C,
+                                           LLVMBasicBlockRef BB);
+void LLVMAnalysisCacheGetDomChildren(LLVMAnalysisCacheRef C,
+                                     LLVMBasicBlockRef BB,
+                                     LLVMBasicBlockRef *Children);
+
+unsigned LLVMAnalysisCacheLoopDepth(LLVMAnalysisCacheRef C,
+                                    LLVMBasicBlockRef BB);
+
+LLVM_C_EXTERN_C_END
+
+#endif
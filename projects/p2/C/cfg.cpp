@@ -10,6 +10,7 @@
 
 /* LLVM Header Files */
 #include "llvm-c/Core.h"
+#include "llvm/Support/CBindingWrapping.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Value.h"
 #include "llvm/IR/Module.h"
@@ -24,6 +25,29 @@
 
 using namespace llvm;
 
+namespace {
+
+// A position in a range of blocks and the end of that range
+template <typename IteratorT> struct BlockCursor {
+  IteratorT Cur, End;
+
+  BlockCursor(IteratorT Begin, IteratorT End) : Cur(Begin), End(End) {}
+
+  BasicBlock *next() {
+    if (Cur == End)
+      return NULL;
+    return *Cur++;
+  }
+};
+
+typedef BlockCursor<succ_iterator> SuccessorCursor;
+typedef BlockCursor<pred_iterator> PredecessorCursor;
+
+} // namespace
+
+DEFINE_SIMPLE_CONVERSION_FUNCTIONS(SuccessorCursor, LLVMSuccessorIteratorRef)
+DEFINE_SIMPLE_CONVERSION_FUNCTIONS(PredecessorCursor, LLVMPredecessorIteratorRef)
+
 LLVMBool LLVMSinglePredecessor(LLVMBasicBlockRef BB)
 {
   pred_iterator PI = pred_begin(unwrap(BB));
@@ -95,6 +119,53 @@ unsigned LLVMCountPredecessors(LLVMBasicBlockRef BB)
   return count;
 }
   
+unsigned LLVMCountSuccessors(LLVMBasicBlockRef BB)
+{
+  return succ_size(unwrap(BB));
+}
+
+void LLVMGetPredecessors(LLVMBasicBlockRef BB, LLVMBasicBlockRef *Preds)
+{
+  for (BasicBlock *Pred : predecessors(unwrap(BB)))
+    *Preds++ = wrap(Pred);
+}
+
+void LLVMGetSuccessors(LLVMBasicBlockRef BB, LLVMBasicBlockRef *Succs)
+{
+  for (BasicBlock *Succ : successors(unwrap(BB)))
+    *Succs++ = wrap(Succ);
+}
+
+LLVMSuccessorIteratorRef LLVMCreateSuccessorIterator(LLVMBasicBlockRef BB)
+{
+  return wrap(new SuccessorCursor(succ_begin(unwrap(BB)), succ_end(unwrap(BB))));
+}
+
+LLVMBasicBlockRef LLVMSuccessorIteratorNext(LLVMSuccessorIteratorRef It)
+{
+  return wrap(unwrap(It)->next());
+}
+
+void LLVMDisposeSuccessorIterator(LLVMSuccessorIteratorRef It)
+{
+  delete unwrap(It);
+}
+
+LLVMPredecessorIteratorRef LLVMCreatePredecessorIterator(LLVMBasicBlockRef BB)
+{
+  return wrap(new PredecessorCursor(pred_begin(unwrap(BB)), pred_end(unwrap(BB))));
+}
+
+LLVMBasicBlockRef LLVMPredecessorIteratorNext(LLVMPredecessorIteratorRef It)
+{
+  return wrap(unwrap(It)->next());
+}
+
+void LLVMDisposePredecessorIterator(LLVMPredecessorIteratorRef It)
+{
+  delete unwrap(It);
+}
+
 LLVMValueRef LLVMCloneInstruction(LLVMValueRef Insn)
 {
   Instruction *insn = (Instruction*)unwrap(Insn);
@@ -25,6 +25,28 @@ LLVMBasicBlockRef LLVMGetFirstPredecessor(LLVMBasicBlockRef BB);
 LLVMBasicBlockRef LLVMGetNextPredecessor(LLVMBasicBlockRef BB, LLVMBasicBlockRef Pred);
 
 unsigned LLVMCountPredecessors(LLVMBasicBlockRef BB);
+unsigned LLVMCountSuccessors(LLVMBasicBlockRef BB);
+
+/* Fill an array of LLVMCountPredecessors/LLVMCountSuccessors entries in one
+   call, in the order the iterators below visit them */
+void LLVMGetPredecessors(LLVMBasicBlockRef BB, LLVMBasicBlockRef *Preds);
+void LLVMGetSuccessors(LLVMBasicBlockRef BB, LLVMBasicBlockRef *Succs);
+
+/* LLVMGetNextSuccessor and LLVMGetNextPredecessor search for the current
+   block on every call. These cursors step in constant time instead; Next
+   returns NULL once every block has been visited. A block is visited once
+   per edge, as with the functions above. Editing BB's terminator, or the
+   uses of BB for predecessors, invalidates an open cursor. */
+typedef struct LLVMOpaqueSuccessorIterator *LLVMSuccessorIteratorRef;
+typedef struct LLVMOpaquePredecessorIterator *LLVMPredecessorIteratorRef;
+
+LLVMSuccessorIteratorRef LLVMCreateSuccessorIterator(LLVMBasicBlockRef BB);
+LLVMBasicBlockRef LLVMSuccessorIteratorNext(LLVMSuccessorIteratorRef It);
+void LLVMDisposeSuccessorIterator(LLVMSuccessorIteratorRef It);
+
+LLVMPredecessorIteratorRef LLVMCreatePredecessorIterator(LLVMBasicBlockRef BB);
+LLVMBasicBlockRef LLVMPredecessorIteratorNext(LLVMPredecessorIteratorRef It);
+void LLVMDisposePredecessorIterator(LLVMPredecessorIteratorRef It);
 
 LLVMValueRef LLVMCloneInstruction(LLVMValueRef Insn);
 LLVMValueRef LLVMFirstInstructionAfterPHI(LLVMBasicBlockRef);
@@ -0,0 +1,456 @@
+/*
+ * File: dataflow.cpp
+ *
+ * Description:
+ *   A bit vector dataflow solver behind the C interface in dataflow.h
+ *
+ *   Blocks are numbered in the order the solver prefers to visit them, and
+ *   every set of the problem lives in one array of 64-bit words per kind,
+ *   a fixed number of words per block. The meet and transfer functions are
+ *   then plain loops over words that the compiler vectorizes. A min-heap on
+ *   block numbers always revisits the earliest changed block first.
+ */
+
+#include <functional>
+#include <queue>
+#include <vector>
+
+/* LLVM Header Files */
+#include "llvm-c/Core.h"
+#include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instruction.h"
+#include "llvm/Support/CBindingWrapping.h"
+
+#include "dataflow.h"
+
+using namespace llvm;
+
+typedef uint64_t Word;
+
+static void copyWords(Word *__restrict Dst, const Word *__restrict Src,
+                      unsigned N) {
+  for (unsigned i = 0; i < N; i++)
+    Dst[i] = Src[i];
+}
+
+static void unionWords(Word *__restrict Dst, const Word *__restrict Src,
+                       unsigned N) {
+  for (unsigned i = 0; i < N; i++)
+    Dst[i] |= Src[i];
+}
+
+static void intersectWords(Word *__restrict Dst, const Word *__restrict Src,
+                           unsigned N) {
+  for (unsigned i = 0; i < N; i++)
+    Dst[i] &= Src[i];
+}
+
+// Dst = Gen | (Src & ~Kill); returns whether Dst changed
+static bool transferWords(Word *__restrict Dst, const Word *__restrict Src,
+                          const Word *__restrict Gen,
+                          const Word *__restrict Kill, unsigned N) {
+  Word Changed = 0;
+  for (unsigned i = 0; i < N; i++) {
+    Word New = Gen[i] | (Src[i] & ~Kill[i]);
+    Changed |= New ^ Dst[i];
+    Dst[i] = New;
+  }
+  return Changed != 0;
+}
+
+static bool testWord(const Word *Set, unsigned Bit) {
+  return (Set[Bit / 64] >> (Bit % 64)) & 1;
+}
+
+static void setWord(Word *Set, unsigned Bit) {
+  Set[Bit / 64] |= Word(1) << (Bit % 64);
+}
+
+static void clearWord(Word *Set, unsigned Bit) {
+  Set[Bit / 64] &= ~(Word(1) << (Bit % 64));
+}
+
+namespace {
+
+// An instruction touches a handful of facts, so its transfer function is
+// kept as lists of bits rather than as sets
+struct InstructionFacts {
+  SmallVector<unsigned, 2> Gen, Kill;
+
+  void apply(Word *Set) const {
+    for (unsigned Bit : Kill)
+      clearWord(Set, Bit);
+    for (unsigned Bit : Gen)
+      setWord(Set, Bit);
+  }
+
+  // Makes (BlockGen, BlockKill) the transfer function of applying itself and
+  // then this instruction
+  void composeInto(Word *BlockGen, Word *BlockKill) const {
+    for (unsigned Bit : Kill) {
+      clearWord(BlockGen, Bit);
+      setWord(BlockKill, Bit);
+    }
+    for (unsigned Bit : Gen)
+      setWord(BlockGen, Bit);
+  }
+};
+
+class Dataflow {
+public:
+  Dataflow(Function *F, unsigned NumBits, LLVMDataflowDirection Direction,
+           LLVMDataflowMeet Meet)
+      : Forward(Direction == LLVMDataflowForward),
+        Union(Meet == LLVMDataflowUnion), Words((NumBits + 63) / 64),
+        Boundary(Words, 0), CachedBlock(NULL) {
+    numberBlocks(F);
+    unsigned N = Blocks.size() * Words;
+    DirectGen.assign(N, 0);
+    DirectKill.assign(N, 0);
+  }
+
+  void setBoundary(unsigned Bit) { setWord(Boundary.data(), Bit); }
+
+  void setGen(BasicBlock *BB, unsigned Bit) {
+    setWord(&DirectGen[number(BB) * Words], Bit);
+  }
+  void setKill(BasicBlock *BB, unsigned Bit) {
+    setWord(&DirectKill[number(BB) * Words], Bit);
+  }
+  void setInstructionGen(Instruction *I, unsigned Bit) {
+    InstFacts[I].Gen.push_back(Bit);
+  }
+  void setInstructionKill(Instruction *I, unsigned Bit) {
+    InstFacts[I].Kill.push_back(Bit);
+  }
+
+  unsigned solve();
+
+  bool blockIn(BasicBlock *BB, unsigned Bit) const {
+    const std::vector<Word> &Side = Forward ? Entry : Exit;
+    return testWord(&Side[number(BB) * Words], Bit);
+  }
+  bool blockOut(BasicBlock *BB, unsigned Bit) const {
+    const std::vector<Word> &Side = Forward ? Exit : Entry;
+    return testWord(&Side[number(BB) * Words], Bit);
+  }
+  bool instructionIn(Instruction *I, unsigned Bit) {
+    return testWord(point(I, 0), Bit);
+  }
+  bool instructionOut(Instruction *I, unsigned Bit) {
+    return testWord(point(I, 1), Bit);
+  }
+
+  unsigned number(BasicBlock *BB) const { return Numbers.lookup(BB); }
+
+private:
+  void numberBlocks(Function *F);
+  const Word *point(Instruction *I, unsigned After);
+
+  // Instructions of a block in the order the flow passes them
+  template <typename Callback> void forEachInFlowOrder(BasicBlock *BB,
+                                                       Callback C) {
+    if (Forward) {
+      for (Instruction &I : *BB)
+        C(I);
+    } else {
+      for (Instruction &I : reverse(*BB))
+        C(I);
+    }
+  }
+
+  bool Forward;
+  bool Union;
+  unsigned Words;
+
+  std::vector<BasicBlock*> Blocks;
+  DenseMap<BasicBlock*, unsigned> Numbers;
+  // Neighbours in the direction of the flow, by block number
+  std::vector<unsigned> PredStart, Preds, SuccStart, Succs;
+  BitVector IsBoundary;
+
+  std::vector<Word> Boundary;
+  std::vector<Word> DirectGen, DirectKill;
+  DenseMap<Instruction*, InstructionFacts> InstFacts;
+
+  // Composed transfer functions and the solution, at the flow entry and
+  // flow exit of each block
+  std::vector<Word> Gen, Kill, Entry, Exit;
+
+  // The last block asked about an instruction of: its instructions in flow
+  // order, their positions in it, and the set at every CheckpointInterval'th
+  // program point in flow order
+  enum { CheckpointInterval = 32 };
+  BasicBlock *CachedBlock;
+  std::vector<Instruction*> CachedFlow;
+  DenseMap<Instruction*, unsigned> CachedPositions;
+  std::vector<Word> Checkpoints;
+  std::vector<Word> Point;
+};
+
+} // namespace
+
+DEFINE_SIMPLE_CONVERSION_FUNCTIONS(Dataflow, LLVMDataflowRef)
+
+// Numbers the blocks in reverse post-order of the flow graph: a depth first
+// walk from the entry block forwards, or from every block without
+// successors backwards. Blocks the walk misses follow in layout order.
+void Dataflow::numberBlocks(Function *F)
+{
+  std::vector<BasicBlock*> Roots;
+  if (Forward) {
+    Roots.push_back(&F->getEntryBlock());
+  } else {
+    for (BasicBlock &BB : *F)
+      if (succ_empty(&BB))
+        Roots.push_back(&BB);
+  }
+
+  auto FlowSuccs = [&](BasicBlock *BB) {
+    std::vector<BasicBlock*> Result;
+    if (Forward)
+      Result.assign(succ_begin(BB), succ_end(BB));
+    else
+      Result.assign(pred_begin(BB), pred_end(BB));
+    return Result;
+  };
+
+  DenseMap<BasicBlock*, bool> Visited;
+  std::vector<BasicBlock*> PostOrder;
+  std::vector<std::pair<BasicBlock*, std::vector<BasicBlock*>>> Stack;
+  for (BasicBlock *Root : Roots) {
+    if (!Visited.insert({Root, true}).second)
+      continue;
+    Stack.push_back({Root, FlowSuccs(Root)});
+    while (!Stack.empty()) {
+      std::vector<BasicBlock*> &Next = Stack.back().second;
+      if (Next.empty()) {
+        PostOrder.push_back(Stack.back().first);
+        Stack.pop_back();
+        continue;
+      }
+      BasicBlock *Succ = Next.back();
+      Next.pop_back();
+      if (Visited.insert({Succ, true}).second)
+        Stack.push_back({Succ, FlowSuccs(Succ)});
+    }
+  }
+
+  Blocks.assign(PostOrder.rbegin(), PostOrder.rend());
+  for (BasicBlock &BB : *F)
+    if (!Visited.count(&BB))
+      Blocks.push_back(&BB);
+  for (unsigned i = 0; i < Blocks.size(); i++)
+    Numbers[Blocks[i]] = i;
+
+  IsBoundary.resize(Blocks.size());
+  for (BasicBlock *Root : Roots)
+    IsBoundary.set(Numbers[Root]);
+
+  // Flow predecessors and successors as ranges of one array each
+  PredStart.push_back(0);
+  SuccStart.push_back(0);
+  for (BasicBlock *BB : Blocks) {
+    for (BasicBlock *P : FlowSuccs(BB))
+      Succs.push_back(Numbers[P]);
+    if (Forward) {
+      for (BasicBlock *P : predecessors(BB))
+        Preds.push_back(Numbers[P]);
+    } else {
+      for (BasicBlock *S : successors(BB))
+        Preds.push_back(Numbers[S]);
+    }
+    PredStart.push_back(Preds.size());
+    SuccStart.push_back(Succs.size());
+  }
+}
+
+unsigned Dataflow::solve()
+{
+  unsigned NumBlocks = Blocks.size();
+  CachedBlock = NULL;
+
+  // Fold the instructions' transfer functions into their blocks'
+  Gen = DirectGen;
+  Kill = DirectKill;
+  if (!InstFacts.empty()) {
+    for (unsigned B = 0; B < NumBlocks; B++) {
+      forEachInFlowOrder(Blocks[B], [&](Instruction &I) {
+        auto Facts = InstFacts.find(&I);
+        if (Facts != InstFacts.end())
+          Facts->second.composeInto(&Gen[B * Words], &Kill[B * Words]);
+      });
+    }
+  }
+
+  Word Init = Union ? 0 : ~Word(0);
+  Entry.assign(NumBlocks * Words, Init);
+  Exit.assign(NumBlocks * Words, Init);
+
+  std::priority_queue<unsigned, std::vector<unsigned>, std::greater<unsigned>>
+      Pending;
+  BitVector Queued(NumBlocks, true);
+  for (unsigned B = 0; B < NumBlocks; B++)
+    Pending.push(B);
+
+  unsigned Visits = 0;
+  while (!Pending.empty()) {
+    unsigned B = Pending.top();
+    Pending.pop();
+    Queued.reset(B);
+    Visits++;
+
+    Word *In = &Entry[B * Words];
+    if (IsBoundary.test(B)) {
+      copyWords(In, Boundary.data(), Words);
+    } else if (PredStart[B] != PredStart[B + 1]) {
+      copyWords(In, &Exit[Preds[PredStart[B]] * Words], Words);
+      for (unsigned i = PredStart[B] + 1; i < PredStart[B + 1]; i++) {
+        if (Union)
+          unionWords(In, &Exit[Preds[i] * Words], Words);
+        else
+          intersectWords(In, &Exit[Preds[i] * Words], Words);
+      }
+    }
+
+    // Every block is queued at the start, so one whose result did not
+    // change has nothing new to tell its successors
+    if (!transferWords(&Exit[B * Words], In, &Gen[B * Words], &Kill[B * Words],
+                       Words))
+      continue;
+    for (unsigned i = SuccStart[B]; i < SuccStart[B + 1]; i++) {
+      if (!Queued.test(Succs[i])) {
+        Queued.set(Succs[i]);
+        Pending.push(Succs[i]);
+      }
+    }
+  }
+  return Visits;
+}
+
+// The program point before (After = 0) or after (After = 1) I. Replays at
+// most CheckpointInterval instructions from the nearest checkpoint, so
+// asking about every instruction of a block costs the same in either order.
+const Word *Dataflow::point(Instruction *I, unsigned After)
+{
+  BasicBlock *BB = I->getParent();
+  if (BB != CachedBlock) {
+    unsigned B = number(BB);
+    CachedBlock = BB;
+    CachedFlow.clear();
+    CachedPositions.clear();
+    unsigned Position = 0;
+    for (Instruction &Inst : *BB)
+      CachedPositions[&Inst] = Position++;
+    forEachInFlowOrder(BB, [&](Instruction &Inst) {
+      CachedFlow.push_back(&Inst);
+    });
+
+    Point.resize(Words);
+    transferWords(Point.data(), &Entry[B * Words], &DirectGen[B * Words],
+                  &DirectKill[B * Words], Words);
+    Checkpoints.clear();
+    for (unsigned Step = 0; Step <= CachedFlow.size(); Step++) {
+      if (Step % CheckpointInterval == 0)
+        Checkpoints.insert(Checkpoints.end(), Point.begin(), Point.end());
+      if (Step == CachedFlow.size())
+        break;
+      auto Facts = InstFacts.find(CachedFlow[Step]);
+      if (Facts != InstFacts.end())
+        Facts->second.apply(Point.data());
+    }
+  }
+
+  // Program point P lies after P instructions in program order, which is
+  // after Size - P of them in flow order going backward
+  unsigned Target = CachedPositions[I] + After;
+  unsigned Step = Forward ? Target : CachedFlow.size() - Target;
+  unsigned From = Step / CheckpointInterval;
+  copyWords(Point.data(), &Checkpoints[From * Words], Words);
+  for (unsigned i = From * CheckpointInterval; i < Step; i++) {
+    auto Facts = InstFacts.find(CachedFlow[i]);
+    if (Facts != InstFacts.end())
+      Facts->second.apply(Point.data());
+  }
+  return Point.data();
+}
+
+LLVMDataflowRef LLVMCreateDataflow(LLVMValueRef Fun, unsigned NumBits,
+                                   LLVMDataflowDirection Direction,
+                                   LLVMDataflowMeet Meet)
+{
+  return wrap(new Dataflow(unwrap<Function>(Fun), NumBits, Direction, Meet));
+}
+
+void LLVMDisposeDataflow(LLVMDataflowRef DF)
+{
+  delete unwrap(DF);
+}
+
+void LLVMDataflowSetBoundary(LLVMDataflowRef DF, unsigned Bit)
+{
+  unwrap(DF)->setBoundary(Bit);
+}
+
+void LLVMDataflowSetGen(LLVMDataflowRef DF, LLVMBasicBlockRef BB,
+                        unsigned Bit)
+{
+  unwrap(DF)->setGen(unwrap(BB), Bit);
+}
+
+void LLVMDataflowSetKill(LLVMDataflowRef DF, LLVMBasicBlockRef BB,
+                         unsigned Bit)
+{
+  unwrap(DF)->setKill(unwrap(BB), Bit);
+}
+
+void LLVMDataflowSetInstructionGen(LLVMDataflowRef DF, LLVMValueRef Inst,
+                                   unsigned Bit)
+{
+  unwrap(DF)->setInstructionGen(unwrap<Instruction>(Inst), Bit);
+}
+
+void LLVMDataflowSetInstructionKill(LLVMDataflowRef DF, LLVMValueRef Inst,
+                                    unsigned Bit)
+{
+  unwrap(DF)->setInstructionKill(unwrap<Instruction>(Inst), Bit);
+}
+
+unsigned LLVMDataflowSolve(LLVMDataflowRef DF)
+{
+  return unwrap(DF)->solve();
+}
+
+LLVMBool LLVMDataflowIn(LLVMDataflowRef DF, LLVMBasicBlockRef BB,
+                        unsigned Bit)
+{
+  return unwrap(DF)->blockIn(unwrap(BB), Bit);
+}
+
+LLVMBool LLVMDataflowOut(LLVMDataflowRef DF, LLVMBasicBlockRef BB,
+                         unsigned Bit)
+{
+  return unwrap(DF)->blockOut(unwrap(BB), Bit);
+}
+
+LLVMBool LLVMDataflowInstructionIn(LLVMDataflowRef DF, LLVMValueRef Inst,
+                                   unsigned Bit)
+{
+  return unwrap(DF)->instructionIn(unwrap<Instruction>(Inst), Bit);
+}
+
+LLVMBool LLVMDataflowInstructionOut(LLVMDataflowRef DF, LLVMValueRef Inst,
+                                    unsigned Bit)
+{
+  return unwrap(DF)->instructionOut(unwrap<Instruction>(Inst), Bit);
+}
+
+unsigned LLVMDataflowBlockNumber(LLVMDataflowRef DF, LLVMBasicBlockRef BB)
+{
+  return unwrap(DF)->number(unwrap(BB));
+}
@@ -0,0 +1,75 @@
+#ifndef DATAFLOW_H
+#define DATAFLOW_H
+
+#include "llvm-c/Core.h"
+#include "llvm-c/DataTypes.h"
+#include "llvm-c/ExternC.h"
+
+LLVM_C_EXTERN_C_BEGIN
+
+/*
+ * An iterative solver for gen/kill problems over bit vectors, such as
+ * reaching definitions, available expressions and liveness. The caller
+ * numbers the facts 0..NumBits-1 and gives each block, or each instruction,
+ * the facts it generates and kills; the solver finds the fixed point of
+ *
+ *   forward:   In(B)  = meet of Out(P) over predecessors P,  Out(B) = f(In(B))
+ *   backward:  Out(B) = meet of In(S) over successors S,     In(B)  = f(Out(B))
+ *
+ * with f(X) = Gen | (X & ~Kill). The entry block (forward) or every block
+ * without successors (backward) starts from the boundary set instead.
+ *
+ * Gen and kill sets given for a block apply at its flow entry; those given
+ * for its instructions follow in flow order. After changing any of them,
+ * solve the problem again.
+ */
+typedef struct LLVMOpaqueDataflow *LLVMDataflowRef;
+
+typedef enum {
+  LLVMDataflowForward,
+  LLVMDataflowBackward
+} LLVMDataflowDirection;
+
+typedef enum {
+  LLVMDataflowUnion,       /* may: any path; sets start empty */
+  LLVMDataflowIntersection /* must: all paths; sets start full */
+} LLVMDataflowMeet;
+
+LLVMDataflowRef LLVMCreateDataflow(LLVMValueRef Fun, unsigned NumBits,
+                                   LLVMDataflowDirection Direction,
+                                   LLVMDataflowMeet Meet);
+void LLVMDisposeDataflow(LLVMDataflowRef DF);
+
+void LLVMDataflowSetBoundary(LLVMDataflowRef DF, unsigned Bit);
+
+void LLVMDataflowSetGen(LLVMDataflowRef DF, LLVMBasicBlockRef BB,
+                        unsigned Bit);
+void LLVMDataflowSetKill(LLVMDataflowRef DF, LLVMBasicBlockRef BB,
+                         unsigned Bit);
+void LLVMDataflowSetInstructionGen(LLVMDataflowRef DF, LLVMValueRef Inst,
+                                   unsigned Bit);
+void LLVMDataflowSetInstructionKill(LLVMDataflowRef DF, LLVMValueRef Inst,
+                                    unsigned Bit);
+
+/* Iterate to the fixed point; returns the number of block visits */
+unsigned LLVMDataflowSolve(LLVMDataflowRef DF);
+
+/* In and Out are the program points before and after a block or an
+   instruction, whatever the direction of the problem */
+LLVMBool LLVMDataflowIn(LLVMDataflowRef DF, LLVMBasicBlockRef BB,
+                        unsigned Bit);
+LLVMBool LLVMDataflowOut(LLVMDataflowRef DF, LLVMBasicBlockRef BB,
+                         unsigned Bit);
+LLVMBool LLVMDataflowInstructionIn(LLVMDataflowRef DF, LLVMValueRef Inst,
+                                   unsigned Bit);
+LLVMBool LLVMDataflowInstructionOut(LLVMDataflowRef DF, LLVMValueRef Inst,
+                                    unsigned Bit);
+
+/* Position of a block in the solver's order: reverse post-order of the CFG
+   for forward problems and of the reverse CFG for backward ones, with
+   blocks the walk does not reach numbered last */
+unsigned LLVMDataflowBlockNumber(LLVMDataflowRef DF, LLVMBasicBlockRef BB);
+
+LLVM_C_EXTERN_C_END
+
+#endif
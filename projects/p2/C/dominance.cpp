@@ -22,123 +22,75 @@
 #include "llvm/Analysis/LoopInfo.h"
 #include "llvm/IR/Type.h"
 
+#include "analysis.h"
 #include "dominance.h"
 
 using namespace llvm;
 
-Function *Current=NULL;
-DominatorTreeBase<BasicBlock,false> *DT=NULL;
-DominatorTreeBase<BasicBlock,true> *PDT=NULL;
-
-LoopInfoBase<BasicBlock,Loop> *LI=NULL;
-
-void UpdateDominators(Function *F)
-{
-  if (Current != F)
-    {
-      Current = F;
-
-      if (DT==NULL)
-	{
-	  DT = new DominatorTreeBase<BasicBlock,false>();
-	  PDT = new DominatorTreeBase<BasicBlock,true>();
-	  if (LI==NULL)
-	    LI = new LoopInfoBase<BasicBlock,Loop>();
-	}
-      
-      DT->recalculate(*F);
-      PDT->recalculate(*F);
-
-      LI->analyze(*DT);
-    }
-}
+// Thin wrappers over the global analysis cache. Callers that edit the CFG
+// must invalidate the function in LLVMGetGlobalAnalysisCache() first.
 
 // Test if a dom b
 LLVMBool LLVMDominates(LLVMValueRef Fun, LLVMBasicBlockRef a, LLVMBasicBlockRef b)
 {
-  UpdateDominators((Function*)unwrap(Fun));
-  return DT->dominates(unwrap(a),unwrap(b));
+  return LLVMAnalysisCacheDominates(LLVMGetGlobalAnalysisCache(), a, b);
 }
 
 // Test if a pdom b
 LLVMBool LLVMPostDominates(LLVMValueRef Fun, LLVMBasicBlockRef a, LLVMBasicBlockRef b)
 {
-  UpdateDominators((Function*)unwrap(Fun));
-  return PDT->dominates(unwrap(a),unwrap(b));
+  return LLVMAnalysisCachePostDominates(LLVMGetGlobalAnalysisCache(), a, b);
 }
 
 LLVMBool LLVMIsReachableFromEntry(LLVMValueRef Fun, LLVMBasicBlockRef bb) {
-  UpdateDominators((Function*)unwrap(Fun));
-  return DT->isReachableFromEntry(unwrap(bb));
+  return LLVMAnalysisCacheIsReachableFromEntry(LLVMGetGlobalAnalysisCache(), bb);
 }
 
 
 LLVMBasicBlockRef LLVMImmDom(LLVMBasicBlockRef BB)
 {
-  UpdateDominators(unwrap(BB)->getParent());
-
-  if ( DT->getNode((BasicBlock*)unwrap(BB)) == NULL )
-    return NULL;
-  
-  if ( DT->getNode((BasicBlock*)unwrap(BB))->getIDom()==NULL )
-    return NULL;
-
-  return wrap(DT->getNode(unwrap(BB))->getIDom()->getBlock());
+  return LLVMAnalysisCacheImmDom(LLVMGetGlobalAnalysisCache(), BB);
 }
 
 LLVMBasicBlockRef LLVMImmPostDom(LLVMBasicBlockRef BB)
 {
-  UpdateDominators(unwrap(BB)->getParent());
-
-  if (PDT->getNode(unwrap(BB))->getIDom()==NULL)
-    return NULL;
-
-  return wrap((BasicBlock*)PDT->getNode(unwrap(BB))->getIDom()->getBlock());
+  return LLVMAnalysisCacheImmPostDom(LLVMGetGlobalAnalysisCache(), BB);
 }
 
 LLVMBasicBlockRef LLVMFirstDomChild(LLVMBasicBlockRef BB)
 {
-  UpdateDominators(unwrap(BB)->getParent());
-  DomTreeNodeBase<BasicBlock> *Node = DT->getNode(unwrap(BB));
-
-  if(Node==NULL)
-    return NULL;
-
-  DomTreeNodeBase<BasicBlock>::iterator it = Node->begin();
-  if (it!=Node->end())
-    return wrap((*it)->getBlock());
-  return NULL;
+  return LLVMAnalysisCacheFirstDomChild(LLVMGetGlobalAnalysisCache(), BB);
 }
 
 LLVMBasicBlockRef LLVMNextDomChild(LLVMBasicBlockRef BB, LLVMBasicBlockRef Child)
 {
-  UpdateDominators(unwrap(BB)->getParent());
-  DomTreeNodeBase<BasicBlock> *Node = DT->getNode(unwrap(BB));
-  DomTreeNodeBase<BasicBlock>::iterator it,end;
+  return LLVMAnalysisCacheNextDomChild(LLVMGetGlobalAnalysisCache(), BB, Child);
+}
 
-  bool next=false;
-  for(it=Node->begin(),end=Node->end(); it!=end; it++)
-    if (next)
-      return wrap((*it)->getBlock());
-    else if (*it==DT->getNode(unwrap(Child)))
-      next=true;
+LLVMDomChildIteratorRef LLVMCreateDomChildIterator(LLVMBasicBlockRef BB)
+{
+  return LLVMAnalysisCacheCreateDomChildIterator(LLVMGetGlobalAnalysisCache(), BB);
+}
 
-  return NULL;
+unsigned LLVMCountDomChildren(LLVMBasicBlockRef BB)
+{
+  return LLVMAnalysisCacheCountDomChildren(LLVMGetGlobalAnalysisCache(), BB);
+}
+
+void LLVMGetDomChildren(LLVMBasicBlockRef BB, LLVMBasicBlockRef *Children)
+{
+  LLVMAnalysisCacheGetDomChildren(LLVMGetGlobalAnalysisCache(), BB, Children);
 }
 
 
 LLVMBasicBlockRef LLVMNearestCommonDominator(LLVMBasicBlockRef A, LLVMBasicBlockRef B)
 {
-  UpdateDominators(unwrap(A)->getParent());
-  return wrap(DT->findNearestCommonDominator(unwrap(A),unwrap(B)));
+  return LLVMAnalysisCacheNearestCommonDominator(LLVMGetGlobalAnalysisCache(), A, B);
 }
 
 unsigned LLVMGetLoopNestingDepth(LLVMBasicBlockRef BB)
 {
-  if (LI==NULL)
-    UpdateDominators(unwrap(BB)->getParent());
-
-  return LI->getLoopDepth(unwrap(BB));
+  return LLVMAnalysisCacheLoopDepth(LLVMGetGlobalAnalysisCache(), BB);
 }
 
 
@@ -161,3 +113,8 @@ LLVMBasicBlockRef LLVMPostDominanceFrontierClosure(LLVMBasicBlockRef BB)
 {
   return NULL;
 }
+
+void LLVMInvalidateDominance(LLVMValueRef Fun)
+{
+  LLVMAnalysisCacheInvalidate(LLVMGetGlobalAnalysisCache(), Fun);
+}
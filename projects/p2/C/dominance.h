@@ -6,6 +6,8 @@
 #include "llvm-c/DataTypes.h"
 #include "llvm-c/ExternC.h"
 
+#include "analysis.h"
+
 LLVM_C_EXTERN_C_BEGIN
 
 LLVMBool LLVMDominates(LLVMValueRef Fun, LLVMBasicBlockRef a, LLVMBasicBlockRef b);
@@ -19,8 +21,16 @@ unsigned LLVMGetLoopNestingDepth(LLVMBasicBlockRef BB);
 
 LLVMBasicBlockRef LLVMFirstDomChild(LLVMBasicBlockRef BB);
 LLVMBasicBlockRef LLVMNextDomChild(LLVMBasicBlockRef BB, LLVMBasicBlockRef Child);
+/* Constant time per child, unlike LLVMNextDomChild; see analysis.h */
+LLVMDomChildIteratorRef LLVMCreateDomChildIterator(LLVMBasicBlockRef BB);
+unsigned LLVMCountDomChildren(LLVMBasicBlockRef BB);
+void LLVMGetDomChildren(LLVMBasicBlockRef BB, LLVMBasicBlockRef *Children);
+
 LLVMBool LLVMIsReachableFromEntry(LLVMValueRef Fun, LLVMBasicBlockRef bb);
 
+/* Forget the cached analyses of Fun after changing its CFG */
+void LLVMInvalidateDominance(LLVMValueRef Fun);
+
 LLVM_C_EXTERN_C_END
 
 #endif
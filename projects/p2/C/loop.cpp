@@ -30,8 +30,26 @@ using namespace llvm;
 
 typedef LoopInfoBase<BasicBlock,Loop> LoopInfoBase2;
 
+namespace {
+
+// A position in a list of sibling loops
+struct LoopCursor {
+  Loop::iterator Cur, End;
+
+  LoopCursor(Loop::iterator Begin, Loop::iterator End) : Cur(Begin), End(End) {}
+
+  Loop *next() {
+    if (Cur == End)
+      return NULL;
+    return *Cur++;
+  }
+};
+
+} // namespace
+
 DEFINE_SIMPLE_CONVERSION_FUNCTIONS(LoopInfoBase2,LLVMLoopInfoRef)
 DEFINE_SIMPLE_CONVERSION_FUNCTIONS(Loop,LLVMLoopRef)
+DEFINE_SIMPLE_CONVERSION_FUNCTIONS(LoopCursor,LLVMLoopIteratorRef)
 
 LLVMLoopInfoRef LLVMCreateLoopInfoRef(LLVMValueRef Fun) {
   LoopInfoBase<BasicBlock,Loop> *LI = new LoopInfoBase<BasicBlock,Loop>();
@@ -129,6 +147,51 @@ LLVMLoopRef LLVMGetNextLoop(LLVMLoopInfoRef LIRef, LLVMLoopRef Loop)
   return NULL;
 }
 
+LLVMLoopIteratorRef LLVMCreateLoopIterator(LLVMLoopInfoRef LIRef)
+{
+  LoopInfoBase2 *LI = unwrap(LIRef);
+  return wrap(new LoopCursor(LI->begin(), LI->end()));
+}
+
+LLVMLoopIteratorRef LLVMCreateSubLoopIterator(LLVMLoopRef L)
+{
+  Loop *l = unwrap(L);
+  return wrap(new LoopCursor(l->begin(), l->end()));
+}
+
+LLVMLoopRef LLVMLoopIteratorNext(LLVMLoopIteratorRef It)
+{
+  return wrap(unwrap(It)->next());
+}
+
+void LLVMDisposeLoopIterator(LLVMLoopIteratorRef It)
+{
+  delete unwrap(It);
+}
+
+unsigned LLVMCountLoops(LLVMLoopInfoRef LIRef)
+{
+  LoopInfoBase2 *LI = unwrap(LIRef);
+  return LI->end() - LI->begin();
+}
+
+void LLVMGetLoops(LLVMLoopInfoRef LIRef, LLVMLoopRef *Loops)
+{
+  for (Loop *L : *unwrap(LIRef))
+    *Loops++ = wrap(L);
+}
+
+unsigned LLVMCountSubLoops(LLVMLoopRef L)
+{
+  return unwrap(L)->getSubLoops().size();
+}
+
+void LLVMGetSubLoops(LLVMLoopRef L, LLVMLoopRef *Loops)
+{
+  for (Loop *Sub : *unwrap(L))
+    *Loops++ = wrap(Sub);
+}
+
 LLVMBool LLVMLoopContainsInst(LLVMLoopRef L, LLVMValueRef Insn)
 {
   Loop *l = unwrap(L);
@@ -30,6 +30,22 @@ extern "C" {
   LLVMLoopRef LLVMGetFirstLoop(LLVMLoopInfoRef LIRef);
   LLVMLoopRef LLVMGetNextLoop(LLVMLoopInfoRef LIRef, LLVMLoopRef Loop);
 
+  /* LLVMGetNextLoop searches for the current loop on every call. A cursor
+     steps through the top-level loops, or the loops directly nested in one
+     loop, in constant time; Next returns NULL after the last one. */
+  typedef struct LLVMOpaqueLoopIterator* LLVMLoopIteratorRef;
+
+  LLVMLoopIteratorRef LLVMCreateLoopIterator(LLVMLoopInfoRef LIRef);
+  LLVMLoopIteratorRef LLVMCreateSubLoopIterator(LLVMLoopRef Loop);
+  LLVMLoopRef LLVMLoopIteratorNext(LLVMLoopIteratorRef It);
+  void LLVMDisposeLoopIterator(LLVMLoopIteratorRef It);
+
+  /* Fill an array of LLVMCountLoops/LLVMCountSubLoops entries in one call */
+  unsigned LLVMCountLoops(LLVMLoopInfoRef LIRef);
+  void LLVMGetLoops(LLVMLoopInfoRef LIRef, LLVMLoopRef *Loops);
+  unsigned LLVMCountSubLoops(LLVMLoopRef Loop);
+  void LLVMGetSubLoops(LLVMLoopRef Loop, LLVMLoopRef *Loops);
+
   LLVMBasicBlockRef LLVMGetPreheader(LLVMLoopRef);
   LLVMBasicBlockRef LLVMGetDedicatedExit(LLVMLoopRef);
 
@@ -23,6 +23,9 @@
 #include "llvm/Support/ManagedStatic.h"
 #include "llvm/Support/SourceMgr.h"
 
+#include "statistics.h"
+#include "stats.h"
+
 using namespace llvm;
 
 extern "C" {
@@ -31,6 +34,7 @@ extern "C" {
 
 static void summarize(Module *M);
 static void print_csv_file(std::string outputfile);
+static void print_json_file(std::string outputfile);
 
 static cl::opt<std::string>
         InputFilename(cl::Positional, cl::desc("<input bitcode>"), cl::Required, cl::init("-"));
@@ -90,18 +94,23 @@ int main(int argc, char **argv) {
     // If requested, do some early optimizations
     if (Mem2Reg)
     {
+        LLVMStatisticsBeginScope("mem2reg", NULL);
         legacy::PassManager Passes;
         Passes.add(createPromoteMemoryToRegisterPass());
         Passes.run(*M.get());
+        LLVMStatisticsEndScope();
     }
 
     if (!NoCSE) {
+        LLVMStatisticsBeginScope("cse", NULL);
         CommonSubexpressionElimination(wrap(M.get()));
+        LLVMStatisticsEndScope();
     }
 
     // Collect statistics on Module
     summarize(M.get());
     print_csv_file(OutputFilename+".stats");
+    print_json_file(OutputFilename+".stats.json");
 
     if (Verbose)
         PrintStatistics(errs());
@@ -155,4 +164,23 @@ static void print_csv_file(std::string outputfile)
     stats.close();
 }
 
-
+// One line per run, read back by wolfbench/jsonstats.py
+static void print_json_file(std::string outputfile)
+{
+    std::error_code EC;
+    raw_fd_ostream stats(outputfile, EC, sys::fs::OF_Text);
+    if (EC) {
+        errs() << outputfile << ": " << EC.message() << "\n";
+        return;
+    }
+    writeStatsJSON(stats, [](json::OStream &J) {
+        J.attribute("tool", "p2");
+        J.attribute("input", InputFilename);
+        J.attribute("output", OutputFilename);
+        J.attributeObject("options", [&] {
+            J.attribute("mem2reg", Mem2Reg.getValue());
+            J.attribute("cse", !NoCSE);
+        });
+        J.attribute("threads", 1);
+    });
+}
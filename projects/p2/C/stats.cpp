@@ -1,21 +1,77 @@
+/*
+ * File: stats.cpp
+ *
+ * Description:
+ *   The C interface in stats.h over the counters and scopes of
+ *   common/statistics.h
+ *
+ *   Counters are kept by name: creating one that exists returns it again
+ *   instead of registering a second copy. Scopes are opened and closed in
+ *   pairs, so they are kept on a stack.
+ */
+
+#include <memory>
+#include <string>
+#include <vector>
+
 /* LLVM Header Files */
+#include "llvm/ADT/StringMap.h"
+#include "llvm/IR/Function.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Value.h"
-#include "llvm/ADT/Statistic.h"
 
+#include "statistics.h"
 #include "stats.h"
 
 using namespace llvm;
 
+namespace {
+
+// Owns the strings, which a StatsCounter does not copy
+struct Counter {
+  std::string Name;
+  std::string Desc;
+  StatsCounter Stat;
+
+  Counter(StringRef N, StringRef D)
+      : Name(N.str()), Desc(D.str()),
+        Stat("", Name.c_str(), Desc.c_str()) {}
+};
+
+} // namespace
+
+static StringMap<std::unique_ptr<Counter>> &counters()
+{
+  static StringMap<std::unique_ptr<Counter>> Counters;
+  return Counters;
+}
+
+static std::vector<std::unique_ptr<StatsScope>> &scopes()
+{
+  static std::vector<std::unique_ptr<StatsScope>> Scopes;
+  return Scopes;
+}
+
 LLVMStatisticsRef LLVMStatisticsCreate(const char* name, const char * descr)
 {
-    Statistic *s = new llvm::Statistic("", name, descr);
-    return (LLVMStatisticsRef) s;
+  std::unique_ptr<Counter> &C = counters()[name];
+  if (!C)
+    C.reset(new Counter(name, descr));
+  return (LLVMStatisticsRef) C.get();
 }
 
 void LLVMStatisticsInc(LLVMStatisticsRef s)
 {
-    Statistic *ref = (Statistic*) s;
-    (*ref)++;
+  ((Counter*) s)->Stat++;
+}
+
+void LLVMStatisticsBeginScope(const char *pass, LLVMValueRef fn)
+{
+  Function *F = fn ? unwrap<Function>(fn) : nullptr;
+  scopes().push_back(std::make_unique<StatsScope>(pass, F));
 }
 
+void LLVMStatisticsEndScope(void)
+{
+  scopes().pop_back();
+}
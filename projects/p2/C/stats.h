@@ -3,6 +3,7 @@
 
 //#include "llvm/Support/DataTypes.h"
 //#include "llvm-c/Core.h"
+#include "llvm-c/Core.h"
 #include "llvm-c/DataTypes.h"
 #include "llvm-c/ExternC.h"
 
@@ -10,9 +11,17 @@ LLVM_C_EXTERN_C_BEGIN
 
 typedef struct LLVMStatisticsOpaque *LLVMStatisticsRef;
 
+/* The counter called name; calling again with the same name returns the same
+   counter */
 LLVMStatisticsRef LLVMStatisticsCreate(const char* name, const char * descr);
 void LLVMStatisticsInc(LLVMStatisticsRef s);
 
+/* Charges the time until the matching End call, and the counters bumped
+   meanwhile outside any inner scope, to pass and, when fn is not NULL, to
+   fn. Scopes nest. */
+void LLVMStatisticsBeginScope(const char *pass, LLVMValueRef fn);
+void LLVMStatisticsEndScope(void);
+
 LLVM_C_EXTERN_C_END
 
-#endif
\ No newline at end of file
+#endif
@@ -10,11 +10,16 @@
 #include "llvm/Analysis/AliasAnalysis.h"
 #include "llvm/ADT/GraphTraits.h"
 #include "llvm/ADT/SCCIterator.h"
+#include "llvm/IR/ValueHandle.h"
 #include "llvm/IR/ValueMap.h"
+#include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/Support/GraphWriter.h"
 #include "llvm/IR/InstIterator.h"
 
+#include <deque>
 #include <map>
+#include <vector>
 
 #include "valmap.h"
 
@@ -48,10 +53,186 @@ LLVMBool valmap_check(valmap_t map, LLVMValueRef v)
 void *valmap_find(valmap_t map, LLVMValueRef v)
 {
   ValueMap<Value*,void*> *vmap = (ValueMap<Value*,void*>*)map;
-  Value *val = unwrap(v);
-  
-  if(vmap->find(val)==vmap->end())
+  ValueMap<Value*,void*>::iterator it = vmap->find(unwrap(v));
+  if(it==vmap->end())
     return NULL;
- 
-  return (*vmap)[val];
+  return it->second;
+}
+
+namespace {
+
+struct DenseValueMap;
+
+// Keeps a tracking map's entry in step with the value holding its number
+class DenseValueHandle final : public CallbackVH {
+  DenseValueMap *Map;
+  unsigned Number;
+
+public:
+  DenseValueHandle(Value *V, DenseValueMap *Map, unsigned Number)
+      : CallbackVH(V), Map(Map), Number(Number) {}
+
+  void deleted() override;
+  void allUsesReplacedWith(Value *New) override;
+};
+
+struct DenseValueMap {
+  bool Tracking;
+  DenseMap<Value*, unsigned> Numbers;
+  std::vector<Value*> Values;
+  std::vector<void*> Data;
+  BitVector Present;
+  // A deque, since handles must not move once registered with their value
+  std::deque<DenseValueHandle> Handles;
+
+  explicit DenseValueMap(bool Tracking) : Tracking(Tracking) {}
+
+  void reset(Function *F) {
+    Numbers.clear();
+    Values.clear();
+    Data.clear();
+    Present.clear();
+    Handles.clear();
+    for (Argument &Arg : F->args())
+      add(&Arg);
+    for (BasicBlock &BB : *F) {
+      add(&BB);
+      for (Instruction &I : BB)
+        add(&I);
+    }
+  }
+
+  unsigned add(Value *V) {
+    unsigned Number = Values.size();
+    Numbers[V] = Number;
+    Values.push_back(V);
+    Data.push_back(NULL);
+    Present.push_back(false);
+    return Number;
+  }
+
+  // Only values with data are tracked, as in ValueMap
+  void set(unsigned Number, void *D) {
+    if (Tracking && !Present[Number] && Values[Number])
+      Handles.emplace_back(Values[Number], this, Number);
+    Data[Number] = D;
+    Present.set(Number);
+  }
+
+  int lookup(Value *V) const {
+    DenseMap<Value*, unsigned>::const_iterator it = Numbers.find(V);
+    return it == Numbers.end() ? -1 : (int)it->second;
+  }
+
+  // Forgets the value holding Number; the number is not handed out again
+  void drop(unsigned Number) {
+    Numbers.erase(Values[Number]);
+    Values[Number] = NULL;
+    Data[Number] = NULL;
+    Present.reset(Number);
+  }
+};
+
+void DenseValueHandle::deleted()
+{
+  Map->drop(Number);
+  CallbackVH::deleted();
+}
+
+// As for ValueMap: the entry moves to New unless New has an entry already
+void DenseValueHandle::allUsesReplacedWith(Value *New)
+{
+  int Existing = Map->lookup(New);
+  if (Existing < 0) {
+    Map->Numbers.erase(getValPtr());
+    Map->Numbers[New] = Number;
+    Map->Values[Number] = New;
+    setValPtr(New);
+    return;
+  }
+  if (!Map->Present[Existing])
+    Map->set(Existing, Map->Data[Number]);
+  Map->drop(Number);
+  setValPtr(NULL);
+}
+
+} // namespace
+
+static densemap_t densemap_create_internal(LLVMValueRef F, bool tracking)
+{
+  DenseValueMap *map = new DenseValueMap(tracking);
+  map->reset(unwrap<Function>(F));
+  return (densemap_t)map;
+}
+
+densemap_t densemap_create(LLVMValueRef F)
+{
+  return densemap_create_internal(F, false);
+}
+
+densemap_t densemap_create_tracking(LLVMValueRef F)
+{
+  return densemap_create_internal(F, true);
+}
+
+void densemap_destroy(densemap_t map)
+{
+  delete (DenseValueMap*)map;
+}
+
+void densemap_reset(densemap_t map, LLVMValueRef F)
+{
+  ((DenseValueMap*)map)->reset(unwrap<Function>(F));
+}
+
+void densemap_insert(densemap_t map, LLVMValueRef v, void *data)
+{
+  densemap_insert_number(map, densemap_number(map, v), data);
+}
+
+LLVMBool densemap_check(densemap_t map, LLVMValueRef v)
+{
+  DenseValueMap *dmap = (DenseValueMap*)map;
+  int number = dmap->lookup(unwrap(v));
+  return (LLVMBool)(number >= 0 && dmap->Present[number]);
+}
+
+void *densemap_find(densemap_t map, LLVMValueRef v)
+{
+  DenseValueMap *dmap = (DenseValueMap*)map;
+  int number = dmap->lookup(unwrap(v));
+  if (number < 0)
+    return NULL;
+  return dmap->Data[number];
+}
+
+unsigned densemap_number(densemap_t map, LLVMValueRef v)
+{
+  DenseValueMap *dmap = (DenseValueMap*)map;
+  Value *val = unwrap(v);
+  int number = dmap->lookup(val);
+  if (number < 0)
+    return dmap->add(val);
+  return number;
+}
+
+LLVMValueRef densemap_value(densemap_t map, unsigned number)
+{
+  DenseValueMap *dmap = (DenseValueMap*)map;
+  return wrap(dmap->Values[number]);
+}
+
+unsigned densemap_size(densemap_t map)
+{
+  return ((DenseValueMap*)map)->Values.size();
+}
+
+void densemap_insert_number(densemap_t map, unsigned number, void *data)
+{
+  ((DenseValueMap*)map)->set(number, data);
+}
+
+void *densemap_find_number(densemap_t map, unsigned number)
+{
+  return ((DenseValueMap*)map)->Data[number];
 }
@@ -31,6 +31,44 @@ LLVMBool valmap_check(valmap_t map, LLVMValueRef key);
   /* Get data for matching key */
 void *valmap_find(valmap_t map, LLVMValueRef key);
 
+/*
+ * densemap_t attaches data to the values of one function, like valmap_t, but
+ * numbers the arguments, blocks and instructions in program order and keeps
+ * the data in an array indexed by number. A value that was not numbered
+ * (a constant, or an instruction created later) gets the next number when it
+ * is first inserted.
+ *
+ * A plain densemap_t does not follow the IR: after a value is erased its
+ * entry must not be used, and a value it is replaced by has no entry. A
+ * tracking densemap_t behaves like valmap_t instead: entries of erased values
+ * are dropped and RAUW moves an entry to the replacement, at the cost of a
+ * value handle per entry.
+ */
+typedef void * densemap_t;
+
+densemap_t densemap_create(LLVMValueRef Function);
+densemap_t densemap_create_tracking(LLVMValueRef Function);
+
+void densemap_destroy(densemap_t);
+
+  /* Drop all data and number the values of Function, reusing the storage */
+void densemap_reset(densemap_t map, LLVMValueRef Function);
+
+void densemap_insert(densemap_t map, LLVMValueRef key, void *data);
+LLVMBool densemap_check(densemap_t map, LLVMValueRef key);
+void *densemap_find(densemap_t map, LLVMValueRef key);
+
+  /* Number of key, numbering it if it has none; and the reverse */
+unsigned densemap_number(densemap_t map, LLVMValueRef key);
+LLVMValueRef densemap_value(densemap_t map, unsigned number);
+
+  /* Numbers handed out so far, all below this */
+unsigned densemap_size(densemap_t map);
+
+  /* Access by number, without looking up the value */
+void densemap_insert_number(densemap_t map, unsigned number, void *data);
+void *densemap_find_number(densemap_t map, unsigned number);
+
 #ifdef __cplusplus
 }
 #endif
@@ -8,17 +8,35 @@
 
 #include "llvm-c/Core.h"
 
+#include "llvm/ADT/SCCIterator.h"
+#include "llvm/ADT/SetVector.h"
 #include "llvm/ADT/Statistic.h"
+#include "llvm/ADT/STLExtras.h"
 #include "llvm/ADT/StringSet.h"
+#include "llvm/ADT/Triple.h"
+#include "llvm/Analysis/AliasAnalysis.h"
+#include "llvm/Analysis/AliasSetTracker.h"
+#include "llvm/Analysis/AssumptionCache.h"
+#include "llvm/Analysis/BasicAliasAnalysis.h"
+#include "llvm/Analysis/CallGraph.h"
+#include "llvm/Analysis/CaptureTracking.h"
+#include "llvm/Analysis/DomTreeUpdater.h"
 #include "llvm/Analysis/InstructionSimplify.h"
+#include "llvm/Analysis/Loads.h"
 #include "llvm/Analysis/LoopInfo.h"
 #include "llvm/Analysis/MemorySSAUpdater.h"
+#include "llvm/Analysis/ScopedNoAliasAA.h"
+#include "llvm/Analysis/TargetLibraryInfo.h"
+#include "llvm/Analysis/TypeBasedAliasAnalysis.h"
+#include "llvm/Analysis/ValueTracking.h"
 #include "llvm/Bitcode/BitcodeReader.h"
 #include "llvm/Bitcode/BitcodeWriter.h"
 #include "llvm/IR/BasicBlock.h"
 #include "llvm/IR/Dominators.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/IntrinsicInst.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/LegacyPassManager.h"
 #include "llvm/IR/Module.h"
@@ -29,18 +47,29 @@
 #include "llvm/LinkAllPasses.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FileUtilities.h"
+#include "llvm/Support/JSON.h"
 #include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/Signals.h"
 #include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/Timer.h"
 #include "llvm/Support/ToolOutputFile.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
 #include "llvm/Transforms/Utils/LoopSimplify.h"
 #include "llvm/Transforms/Utils/LoopUtils.h"
+#include "llvm/Transforms/Utils/SSAUpdater.h"
+
+#include "parallel.h"
+#include "statistics.h"
 
 using namespace llvm;
 
 static void LoopInvariantCodeMotion(Module *M);
+static void optimizeLazily(Module &M);
 
 static void summarize(Module *M);
-static void print_csv_file(std::string outputfile);
+static void print_csv_file(std::string outputfile, const PhaseReport &Phases);
+static void print_json_file(std::string outputfile, const PhaseReport &Phases);
 
 static cl::opt<std::string> InputFilename(cl::Positional,
                                           cl::desc("<input bitcode>"),
@@ -62,12 +91,46 @@ static cl::opt<bool> NoLICM("no-licm",
                             cl::desc("Do not perform LICM optimization."),
                             cl::init(false));
 
+static cl::opt<bool> Speculate(
+    "licm-speculate",
+    cl::desc("Hoist loads that do not run on every iteration when their "
+             "address is known to be dereferenceable."),
+    cl::init(false));
+
+static cl::opt<unsigned> SpeculationCap(
+    "licm-speculate-cap",
+    cl::desc("Most loads speculated into one loop preheader."),
+    cl::value_desc("N"), cl::init(8));
+
+static cl::opt<bool> VerifyDomTree(
+    "verify-licm-domtree",
+    cl::desc("Check the dominator tree against a full recalculation after "
+             "LICM of each loop."),
+    cl::init(false));
+
+static cl::opt<unsigned>
+    Threads("j", cl::desc("Optimize functions in parallel on <N> threads."),
+            cl::value_desc("N"), cl::init(1));
+
+static cl::opt<bool> Lazy(
+    "lazy",
+    cl::desc("Load function bodies one at a time and optimize each as soon as "
+             "it is loaded, then stream the output bitcode (flushed every "
+             "-bitcode-flush-threshold MB). Skips attribute inference."),
+    cl::init(false));
+
 static cl::opt<bool> Verbose("verbose", cl::desc("Verbose stats."),
                              cl::init(false));
 
 static cl::opt<bool> NoCheck("no", cl::desc("Do not check for valid IR."),
                              cl::init(false));
 
+static cl::opt<bool> TimeReport(
+    "time-report",
+    cl::desc("Time every phase of the run and sample its memory use. The "
+             "results are printed and added to the .stats files."),
+    cl::init(false));
+
 int main(int argc, char **argv) {
     // Parse command line arguments
     cl::ParseCommandLineOptions(argc, argv, "llvm system compiler\n");
@@ -76,18 +139,28 @@ int main(int argc, char **argv) {
     llvm_shutdown_obj Y; // Call llvm_shutdown() on exit.
     LLVMContext Context;
 
-    // LLVM idiom for constructing output file.
+    // LLVM idiom for constructing output file. With -lazy the writer needs a
+    // raw_fd_stream to flush to, which is opened when the output is written.
     std::unique_ptr<ToolOutputFile> Out;
     std::string ErrorInfo;
     std::error_code EC;
-    Out.reset(new ToolOutputFile(OutputFilename.c_str(), EC, sys::fs::OF_None));
+    if (!Lazy) {
+        Out.reset(
+            new ToolOutputFile(OutputFilename.c_str(), EC, sys::fs::OF_None));
+    }
 
     EnableStatistics();
+    PhaseReport Phases(TimeReport, "p3");
 
     // Read in module
+    Phases.start("parse", "Parse Input");
     SMDiagnostic Err;
     std::unique_ptr<Module> M;
-    M = parseIRFile(InputFilename, Err, Context);
+    if (Lazy) {
+        M = getLazyIRFileModule(InputFilename, Err, Context, true);
+    } else {
+        M = parseIRFile(InputFilename, Err, Context);
+    }
 
     // If errors, fail
     if (M.get() == 0) {
@@ -95,37 +168,90 @@ int main(int argc, char **argv) {
         return 1;
     }
 
-    // If requested, do some early optimizations
-    if (Mem2Reg || CSE) {
-        legacy::PassManager Passes;
-        if (Mem2Reg)
-            Passes.add(createPromoteMemoryToRegisterPass());
-        if (CSE)
-            Passes.add(createEarlyCSEPass());
-        Passes.run(*M.get());
-    }
+    if (Lazy && Threads <= 1) {
+        Phases.start("optimize", "Load and Optimize Functions");
+        optimizeLazily(*M);
+    } else {
+        // The parallel driver starts from the bitcode of the whole module, so
+        // there is nothing to gain from loading it lazily
+        if (Error E = M->materializeAll()) {
+            errs() << argv[0] << ": " << toString(std::move(E)) << "\n";
+            return 1;
+        }
 
-    if (!NoLICM) {
-        LoopInvariantCodeMotion(M.get());
+        // If requested, do some early optimizations
+        if (Mem2Reg || CSE) {
+            Phases.start("prepare", "Early Optimizations");
+            StatsScope Scope("prepare");
+            legacy::PassManager Passes;
+            if (Mem2Reg)
+                Passes.add(createPromoteMemoryToRegisterPass());
+            if (CSE)
+                Passes.add(createEarlyCSEPass());
+            Passes.run(*M.get());
+        }
+
+        if (!NoLICM) {
+            Phases.start("licm", "Loop Invariant Code Motion");
+            LoopInvariantCodeMotion(M.get());
+        }
     }
 
     // Collect statistics on Module
+    Phases.start("summarize", "Summarize Module");
     summarize(M.get());
-    print_csv_file(OutputFilename);
-
-    if (Verbose)
-        PrintStatistics(errs());
 
     // Verify integrity of Module, do this by default
     if (!NoCheck) {
+        Phases.start("verify", "Verify Module");
         legacy::PassManager Passes;
         Passes.add(createVerifierPass());
         Passes.run(*M.get());
     }
 
     // Write final bitcode
-    WriteBitcodeToFile(*M.get(), Out->os());
-    Out->keep();
+    Phases.start("write", "Write Bitcode");
+    if (Lazy) {
+        raw_fd_stream Stream(OutputFilename, EC);
+        if (EC) {
+            errs() << argv[0] << ": " << OutputFilename << ": "
+                   << EC.message() << "\n";
+            return 1;
+        }
+        // Like a ToolOutputFile, a partial output is removed if the write
+        // fails or the run is interrupted
+        FileRemover Remover(OutputFilename);
+        sys::RemoveFileOnSignal(OutputFilename);
+        WriteBitcodeToFile(*M.get(), Stream);
+        Stream.close();
+        if (Stream.has_error()) {
+            errs() << argv[0] << ": " << OutputFilename << ": "
+                   << Stream.error().message() << "\n";
+            Stream.clear_error();
+            return 1;
+        }
+        Remover.releaseFile();
+        sys::DontRemoveFileOnSignal(OutputFilename);
+    } else {
+        WriteBitcodeToFile(*M.get(), Out->os());
+        Out->os().close();
+        if (Out->os().has_error()) {
+            errs() << argv[0] << ": " << OutputFilename << ": "
+                   << Out->os().error().message() << "\n";
+            Out->os().clear_error();
+            return 1;
+        }
+        Out->keep();
+    }
+    Phases.finish();
+
+    print_csv_file(OutputFilename, Phases);
+    print_json_file(OutputFilename, Phases);
+
+    if (Verbose)
+        PrintStatistics(errs());
+    if (TimeReport)
+        Phases.print(errs());
 
     return 0;
 }
@@ -156,34 +282,79 @@ static void summarize(Module *M) {
     }
 }
 
-static void print_csv_file(std::string outputfile) {
+static void print_csv_file(std::string outputfile, const PhaseReport &Phases) {
     std::ofstream stats(outputfile + ".stats");
+    // Sorted, since statistics register in the order they are first bumped,
+    // which differs between serial and parallel runs
     auto a = GetStatistics();
+    std::sort(a.begin(), a.end());
     for (auto p : a) {
         stats << p.first.str() << "," << p.second << std::endl;
     }
+    // Whole numbers, like the counters: microseconds and KiB
+    for (auto &P : Phases.phases()) {
+        stats << "Time." << P.Name << "," << uint64_t(P.Seconds * 1e6)
+              << std::endl;
+        stats << "PeakRSSSoFar." << P.Name << "," << P.PeakRSSSoFar
+              << std::endl;
+        stats << "Heap." << P.Name << "," << P.Heap << std::endl;
+    }
     stats.close();
 }
 
-static llvm::Statistic NumLoops = {"", "NumLoops", "number of loops analyzed"};
-static llvm::Statistic NumLoopsNoStore = {"", "NumLoopsNoStore",
-                                          "number of loops without stores"};
-static llvm::Statistic NumLoopsNoLoad = {"", "NumLoopsNoLoad",
-                                         "number of loops without loads"};
-static llvm::Statistic NumLoopsNoStoreWithLoad = {
+static void print_json_file(std::string outputfile,
+                            const PhaseReport &Phases) {
+    std::error_code EC;
+    raw_fd_ostream OS(outputfile + ".stats.json", EC, sys::fs::OF_Text);
+    if (EC) {
+        errs() << outputfile << ".stats.json: " << EC.message() << "\n";
+        return;
+    }
+    writeStatsJSON(
+        OS,
+        [](json::OStream &J) {
+            J.attribute("tool", "p3");
+            J.attribute("input", InputFilename);
+            J.attribute("output", OutputFilename);
+            J.attributeObject("options", [&] {
+                J.attribute("mem2reg", Mem2Reg.getValue());
+                J.attribute("cse", CSE.getValue());
+                J.attribute("licm", !NoLICM);
+                J.attribute("licm-speculate", Speculate.getValue());
+                J.attribute("licm-speculate-cap", SpeculationCap.getValue());
+            });
+            J.attribute("threads", Threads.getValue());
+        },
+        &Phases);
+}
+
+static StatsCounter NumLoops = {"", "NumLoops", "number of loops analyzed"};
+static StatsCounter NumLoopsNoStore = {"", "NumLoopsNoStore",
+                                       "number of loops without stores"};
+static StatsCounter NumLoopsNoLoad = {"", "NumLoopsNoLoad",
+                                      "number of loops without loads"};
+static StatsCounter NumLoopsNoStoreWithLoad = {
     "", "NumLoopsNoStoreWithLoad",
     "number of loops without store but with load"};
-static llvm::Statistic NumLoopsWithCall = {"", "NumLoopsWithCall",
-                                           "number of loops with calls"};
+static StatsCounter NumLoopsWithCall = {"", "NumLoopsWithCall",
+                                        "number of loops with calls"};
 // add other stats
-static llvm::Statistic LICMBasic = {"", "LICMBasic",
-                                    "basic loop invariant instructions"};
-static llvm::Statistic LICMLoadHoist = {"", "LICMLoadHoist",
-                                        "loop invariant load instructions"};
-static llvm::Statistic LICMStoreSink = {"", "LICMStoreSink",
-                                        "loop invariant store instructions"};
-static llvm::Statistic LICMNoPreheader = {
+static StatsCounter LICMBasic = {"", "LICMBasic",
+                                 "basic loop invariant instructions"};
+static StatsCounter LICMLoadHoist = {"", "LICMLoadHoist",
+                                     "loop invariant load instructions"};
+static StatsCounter LICMSpeculated = {
+    "", "LICMSpeculated", "loads hoisted speculatively"};
+static StatsCounter LICMCallHoist = {
+    "", "LICMCallHoist", "loop invariant readnone or readonly calls"};
+static StatsCounter LICMStoreSink = {"", "LICMStoreSink",
+                                     "loop invariant store instructions"};
+static StatsCounter LICMNoPreheader = {
     "", "LICMNoPreheader", "absence of preheader prevents optimization"};
+static StatsCounter LICMPreheaderInserted = {
+    "", "LICMPreheaderInserted", "loops given a preheader"};
+static StatsCounter LICMExitSplit = {
+    "", "LICMExitSplit", "loop exits split to give sunk stores a block"};
 
 void printStats() {
     // Print stats
@@ -195,19 +366,23 @@ void printStats() {
     errs() << "LICMBasic: " << LICMBasic << "\n";
     errs() << "LICMLoadHoist: " << LICMLoadHoist << "\n";
     errs() << "LICMNoPreheader: " << LICMNoPreheader << "\n";
+    errs() << "LICMPreheaderInserted: " << LICMPreheaderInserted << "\n";
+    errs() << "LICMExitSplit: " << LICMExitSplit << "\n";
+    errs() << "LICMSpeculated: " << LICMSpeculated << "\n";
+    errs() << "LICMCallHoist: " << LICMCallHoist << "\n";
     errs() << "LICMStoreSink: " << LICMStoreSink << "\n";
 }
 
-// CSE Method Signatures
-void printCSEStats();
-static void CommonSubexpressionElimination(Module *M);
-
+// Whether `I` runs before the loop is left on any path. The blocks inside
+// the loop that branch out are checked rather than the exit blocks, which
+// may also be reached from outside the loop: loops are not given dedicated
+// exits until a store is sunk (see LoopExitBlocks).
 bool dominatesAllExits(const Instruction *I, const Loop *L,
-                       const DominatorTreeBase<BasicBlock, false> *DT) {
-    SmallVector<BasicBlock *, 8> ExitBlocks;
-    L->getExitBlocks(ExitBlocks);
-    for (auto exitBlock : ExitBlocks) {
-        bool dominated = DT->dominates(I->getParent(), exitBlock);
+                       const DominatorTree *DT) {
+    SmallVector<BasicBlock *, 8> ExitingBlocks;
+    L->getExitingBlocks(ExitingBlocks);
+    for (auto exitingBlock : ExitingBlocks) {
+        bool dominated = DT->dominates(I->getParent(), exitingBlock);
         if (!dominated) {
             return false;
         }
@@ -215,185 +390,511 @@ bool dominatesAllExits(const Instruction *I, const Loop *L,
     return true;
 }
 
-bool isSameAddress(const Value *addr1, const Value *addr2) {
-    bool isSame = false;
-    if (const AllocaInst *alloca = dyn_cast<AllocaInst>(addr1)) {
-        if (alloca == addr2) {
-            isSame = true;
-        }
-    } else if (const GlobalVariable *global = dyn_cast<GlobalVariable>(addr1)) {
-        if (global == addr2) {
-            isSame = true;
+// The phase timers are shared by every function; when functions are optimized
+// on several threads only the whole pass is timed.
+static bool timeFunctionPhases() {
+    return TimePassesIsEnabled && Threads <= 1;
+}
+
+// Dominator tree used by CSE. It is computed the first time it is requested
+// for a function and reused until another function is queried; CSE only
+// erases non-terminators, so the tree stays valid while it runs.
+class CSEAnalysisCache {
+  public:
+    DominatorTree &getDomTree(Function &F) {
+        if (DTFunction != &F) {
+            NamedRegionTimer T("domtree", "Dominator Tree Construction", "p3",
+                               "p3 LICM", timeFunctionPhases());
+            DT.recalculate(F);
+            DTFunction = &F;
         }
-    } else {
-        isSame = true;
+        return DT;
     }
-    return isSame;
-}
 
-bool canMoveStoreOutOfLoop(const Loop *L, const StoreInst *store,
-                           const DominatorTreeBase<BasicBlock, false> *DT) {
-    //   Requirements:
-    // 1. Always store to same address
-    // 2. No loads can be present to same address
-    // 3. Always execute before loop exits
+  private:
+    DominatorTree DT;
+    Function *DTFunction = nullptr;
+};
 
-    const Value *storeAddr = store->getPointerOperand();
-    // If store is volatile, return false
-    if (store->isVolatile()) {
-        return false;
+// CSE Method Signatures
+void printCSEStats();
+static void CommonSubexpressionElimination(Function &F,
+                                           CSEAnalysisCache &Analyses);
+
+// Alias analyses for LICM. BasicAA tells apart distinct allocas, globals and
+// constant offsets from one base; TBAA and scoped noalias use what the
+// frontend attached to the accesses.
+struct LICMAliasAnalyses {
+    TargetLibraryInfoImpl TLII;
+    TargetLibraryInfo TLI;
+    AssumptionCache AC;
+    BasicAAResult BasicAA;
+    TypeBasedAAResult TBAA;
+    ScopedNoAliasAAResult ScopedNoAlias;
+    AAResults AA;
+
+    LICMAliasAnalyses(Function &F, DominatorTree &DT)
+        : TLII(Triple(F.getParent()->getTargetTriple())), TLI(TLII), AC(F),
+          BasicAA(F.getParent()->getDataLayout(), F, TLI, AC, &DT), AA(TLI) {
+        AA.addAAResult(BasicAA);
+        AA.addAAResult(TBAA);
+        AA.addAAResult(ScopedNoAlias);
     }
-
-    bool hasLoads = false;
-    bool hasAnyLoads = false;
-    bool isAlloca = isa<AllocaInst>(storeAddr);
-
-    // Going through all the instructions in the loop
-    for (auto BB : L->getBlocks()) {
-        for (auto instrPtr = BB->begin(); instrPtr != BB->end(); instrPtr++) {
-            const Instruction *I = &*instrPtr;
-            switch (I->getOpcode()) {
-            case Instruction::Load: {
-                const LoadInst *load = cast<LoadInst>(I);
-                hasAnyLoads = true;
-                hasLoads = hasLoads ||
-                           isSameAddress(load->getPointerOperand(), storeAddr);
-                break;
-            }
-            case Instruction::Store: {
-                if (store == I) {
-                    continue;
+};
+
+// Memory accesses of one loop, summarized once before any of its instructions
+// are moved and kept up to date as loads are hoisted and stores sunk.
+//
+// Loads and stores are counted by identified underlying object and, where the
+// address is a constant offset from it, by byte offset. Most candidates are
+// an array element or scalar that nothing else in the loop touches, which the
+// counts answer directly. Only the remaining queries need alias sets, and the
+// tracker is built the first time one is asked: adding every access of a
+// large unrolled loop to it costs an alias query against each existing set.
+class LoopMemorySummary {
+  public:
+    LoopMemorySummary(const Loop *L, AAResults &AA, const DataLayout &DL)
+        : L(L), AA(AA), DL(DL) {
+        NamedRegionTimer T("summary", "Loop Memory Summary", "p3", "p3 LICM",
+                           timeFunctionPhases());
+        for (auto BB : L->getBlocks()) {
+            for (auto &I : *BB) {
+                MayStop |= !isGuaranteedToTransferExecutionToSuccessor(&I);
+                if (auto *load = dyn_cast<LoadInst>(&I)) {
+                    HasVolatile |= load->isVolatile();
+                    count(getLocation(load), &Counts::Loads, 1);
+                } else if (auto *store = dyn_cast<StoreInst>(&I)) {
+                    HasVolatile |= store->isVolatile();
+                    NumStores[store->getPointerOperand()]++;
+                    count(getLocation(store), &Counts::Stores, 1);
+                } else {
+                    // Calls, atomics and fences
+                    MayReadOther |= I.mayReadFromMemory();
+                    MayWriteOther |= I.mayWriteToMemory();
+                    MayThrow |= I.mayThrow();
                 }
-                hasAnyLoads = true;
-                const StoreInst *store2 = cast<StoreInst>(I);
-                if (isSameAddress(store2->getPointerOperand(), storeAddr)) {
-                    hasLoads = true;
-                }
-                break;
             }
-            case Instruction::Call: {
-                const CallInst *call = cast<CallInst>(I);
-                if (call->isIdempotent()) {
-                    hasAnyLoads = true;
-                    hasLoads = true;
-                }
-                break;
+        }
+    }
+
+    // Whether anything in the loop may write the location `load` reads
+    bool mayWriteLocationOf(const LoadInst *load) {
+        Location loc = getLocation(load);
+        if (!HasVolatile && !HasUnknownStores && !MayWriteOther &&
+            loc.Object && overlapping(loc).Stores == 0) {
+            return false;
+        }
+        return getAliasSets().getAliasSetFor(MemoryLocation::get(load)).isMod();
+    }
+
+    // Whether `store` is the only access in the loop to its location
+    bool isOnlyAccessTo(const StoreInst *store) {
+        if (NumStores.lookup(store->getPointerOperand()) != 1) {
+            return false;
+        }
+        Location loc = getLocation(store);
+        if (!HasVolatile && !HasUnknownLoads && !HasUnknownStores &&
+            !MayReadOther && !MayWriteOther && loc.Object && loc.Precise) {
+            Counts overlap = overlapping(loc);
+            if (overlap.Loads == 0 && overlap.Stores == 1) {
+                return true;
             }
-            default: {
-                break;
+        }
+        AliasSet &AS =
+            getAliasSets().getAliasSetFor(MemoryLocation::get(store));
+        return AS.isMustAlias() && !AS.isRef() && AS.size() == 1;
+    }
+
+    // Whether anything in the loop may write memory at all
+    bool mayWriteMemory() const {
+        return HasUnknownStores || MayWriteOther || !NumStores.empty();
+    }
+
+    // Whether the loop may be left by unwinding rather than through an exit
+    bool mayThrow() const { return MayThrow; }
+
+    // Whether anything in the loop may unwind, exit the program or otherwise
+    // keep execution from reaching the next instruction
+    bool mayStop() const { return MayStop; }
+
+    // Called once `load` has been moved out of the loop
+    void removeLoad(const LoadInst *load) {
+        count(getLocation(load), &Counts::Loads, -1);
+    }
+
+    // Called before `store` is sunk out of the loop and erased
+    void removeStore(const StoreInst *store) {
+        const Value *storeAddr = store->getPointerOperand();
+        if (--NumStores[storeAddr] == 0) {
+            NumStores.erase(storeAddr);
+        }
+        count(getLocation(store), &Counts::Stores, -1);
+    }
+
+  private:
+    struct Counts {
+        unsigned Loads = 0;
+        unsigned Stores = 0;
+    };
+
+    struct ObjectCounts {
+        // Every access of the object
+        Counts All;
+        // Accesses whose offset or size is not known
+        Counts Imprecise;
+        // Largest precise access
+        uint64_t MaxSize = 0;
+    };
+
+    // Byte range an access covers. Object is null unless the address is
+    // based on an identified object; Offset and Size are only meaningful if
+    // Precise is set.
+    struct Location {
+        const Value *Object = nullptr;
+        bool Precise = false;
+        int64_t Offset = 0;
+        uint64_t Size = 0;
+    };
+
+    // Overlap checks look at every offset an access may start at, so only
+    // small accesses are counted by offset
+    static const uint64_t MaxPreciseSize = 32;
+
+    Location getLocation(const LoadInst *load) const {
+        return getLocation(load->getPointerOperand(), load->getType());
+    }
+
+    Location getLocation(const StoreInst *store) const {
+        return getLocation(store->getPointerOperand(),
+                           store->getValueOperand()->getType());
+    }
+
+    Location getLocation(const Value *addr, Type *type) const {
+        TypeSize size = DL.getTypeStoreSize(type);
+
+        int64_t offset = 0;
+        const Value *base = GetPointerBaseWithConstantOffset(addr, offset, DL);
+        const Value *object = getUnderlyingObject(base);
+
+        Location loc;
+        if (isIdentifiedObject(object)) {
+            loc.Object = object;
+            loc.Precise = base == object && !size.isScalable() &&
+                          size.getFixedSize() <= MaxPreciseSize;
+            loc.Offset = offset;
+            loc.Size = size.getKnownMinSize();
+        }
+        return loc;
+    }
+
+    void count(const Location &loc, unsigned Counts::*kind, int delta) {
+        if (!loc.Object) {
+            if (kind == &Counts::Loads) {
+                HasUnknownLoads = true;
+            } else {
+                HasUnknownStores = true;
             }
+            return;
+        }
+        ObjectCounts &object = Objects[loc.Object];
+        object.All.*kind += delta;
+        if (loc.Precise) {
+            Locations[{loc.Object, loc.Offset}].*kind += delta;
+            object.MaxSize = std::max(object.MaxSize, loc.Size);
+        } else {
+            object.Imprecise.*kind += delta;
+        }
+    }
+
+    // Accesses of the loop that may overlap `loc`
+    Counts overlapping(const Location &loc) const {
+        auto It = Objects.find(loc.Object);
+        if (It == Objects.end()) {
+            return Counts();
+        }
+        const ObjectCounts &object = It->second;
+        if (!loc.Precise) {
+            return object.All;
+        }
+        Counts total = object.Imprecise;
+        int64_t first = loc.Offset - int64_t(object.MaxSize) + 1;
+        int64_t last = loc.Offset + int64_t(loc.Size) - 1;
+        for (int64_t offset = first; offset <= last; offset++) {
+            auto At = Locations.find({loc.Object, offset});
+            if (At != Locations.end()) {
+                total.Loads += At->second.Loads;
+                total.Stores += At->second.Stores;
             }
         }
+        return total;
     }
 
-    bool isAllocaInsideLoop = false;
-    if (isAlloca) {
-        if (const Instruction *addrInst = dyn_cast<Instruction>(storeAddr)) {
-            isAllocaInsideLoop = L->contains(addrInst->getParent());
+    // Built from the loop as it is now, so hoisted loads and sunk stores are
+    // no longer in it
+    AliasSetTracker &getAliasSets() {
+        if (!AST) {
+            NamedRegionTimer T("aliassets", "Loop Alias Sets", "p3",
+                               "p3 LICM", timeFunctionPhases());
+            AST = std::make_unique<AliasSetTracker>(AA);
+            for (auto BB : L->getBlocks()) {
+                AST->add(*BB);
+            }
         }
+        return *AST;
     }
 
-    if (isa<GlobalVariable>(storeAddr) && !hasLoads) {
-        return true;
+    const Loop *L;
+    AAResults &AA;
+    const DataLayout &DL;
+    std::unique_ptr<AliasSetTracker> AST;
+    // Stores in the loop by pointer operand
+    DenseMap<const Value *, unsigned> NumStores;
+    // Accesses by identified underlying object, and by object and offset for
+    // the precise ones
+    DenseMap<const Value *, ObjectCounts> Objects;
+    DenseMap<std::pair<const Value *, int64_t>, Counts> Locations;
+    bool HasUnknownLoads = false;
+    bool HasUnknownStores = false;
+    bool HasVolatile = false;
+    bool MayReadOther = false;
+    bool MayWriteOther = false;
+    bool MayThrow = false;
+    bool MayStop = false;
+};
+
+// Loads and stores moved out of the loop run even when the loop would have
+// exited before reaching them. Allocas and globals can always be accessed,
+// except weak globals that may turn out to be null.
+static bool isAlwaysDereferenceable(const Value *addr) {
+    if (auto *global = dyn_cast<GlobalVariable>(addr)) {
+        return !global->hasExternalWeakLinkage();
     }
-    if (isAlloca && !hasLoads && !isAllocaInsideLoop) {
-        return true;
+    return isa<AllocaInst>(addr);
+}
+
+// An alloca whose address never leaves the function. No other thread or
+// caller can see it, so a store to it may be added on a path that had none.
+static bool isUnobservable(const Value *addr) {
+    return isa<AllocaInst>(addr) && isNonEscapingLocalObject(addr);
+}
+
+bool canMoveStoreOutOfLoop(const Loop *L, const StoreInst *store,
+                           const DominatorTree *DT,
+                           LoopMemorySummary &Mem) {
+    //   Requirements:
+    // 1. Always store to same address
+    // 2. Nothing else in the loop reads or writes that address
+    // 3. Every exit store writes what the loop would have written: the store
+    //    runs before each exit and the loop cannot unwind past it, or the
+    //    address is an alloca no one else can see
+    const Value *storeAddr = store->getPointerOperand();
+    if (!store->isSimple() || !L->isLoopInvariant(storeAddr)) {
+        return false;
     }
-    if (!hasAnyLoads && L->isLoopInvariant(storeAddr) &&
-        // 3. Always execute before loop exits
-        dominatesAllExits(store, L, DT)) {
-        return true;
+
+    if (!Mem.isOnlyAccessTo(store)) {
+        return false;
     }
 
-    return false;
+    return isUnobservable(storeAddr) ||
+           (dominatesAllExits(store, L, DT) && !Mem.mayThrow());
 }
 
+// Sets `speculative` if the load may not run on every trip through the loop,
+// so hoisting it needs -licm-speculate.
 bool canMoveLoadOutOfLoop(const Loop *L, const LoadInst *load,
-                          const DominatorTreeBase<BasicBlock, false> *DT) {
+                          const DominatorTree *DT, LoopMemorySummary &Mem,
+                          bool &speculative) {
     const Value *loadAddr = load->getPointerOperand();
-    // If load is volatile, return false
-    if (load->isVolatile()) {
+    speculative = false;
+    if (!load->isSimple() || !L->isLoopInvariant(loadAddr)) {
         return false;
     }
 
-    bool hasStores = false;
-    bool hasAnyStores = false;
-    bool isAlloca = isa<AllocaInst>(loadAddr);
-
-    // Going through all the instructions in the loop
-    for (auto BB : L->getBlocks()) {
-        for (auto instrPtr = BB->begin(); instrPtr != BB->end(); instrPtr++) {
-            const Instruction *I = &*instrPtr;
-            switch (I->getOpcode()) {
-            case Instruction::Store: {
-                auto store = cast<StoreInst>(I);
-                hasAnyStores = true;
-                hasStores = hasStores ||
-                            isSameAddress(store->getPointerOperand(), loadAddr);
-                break;
-            }
-            case Instruction::Call: {
-                const CallInst *call = cast<CallInst>(I);
-                if (!call->isIdempotent()) {
-                    hasAnyStores = true;
-                    hasStores = true;
-                }
-                break;
-            }
-            default: {
-                break;
+    // Nothing in the loop may write the loaded location
+    if (Mem.mayWriteLocationOf(load)) {
+        return false;
+    }
+
+    if (isAlwaysDereferenceable(loadAddr) || dominatesAllExits(load, L, DT)) {
+        return true;
+    }
+
+    // Otherwise the preheader would run a load the loop may have skipped,
+    // which is only safe if the address is valid there already
+    speculative = true;
+    const Instruction *preHeaderEnd = L->getLoopPreheader()->getTerminator();
+    return Speculate &&
+           isDereferenceableAndAlignedPointer(
+               loadAddr, load->getType(), load->getAlign(),
+               load->getModule()->getDataLayout(), preHeaderEnd, DT);
+}
+
+// Whether `I` runs on the first trip through the loop whenever the loop is
+// entered, the same test as LLVM's SimpleLoopSafetyInfo. Anything in the loop
+// that may stop execution can run before `I` on some path, whether or not its
+// block dominates `I`, so then only the header up to `I` is certain.
+// Otherwise `I` runs if its block is on every path out of the header, that is
+// it dominates every exit and every latch.
+static bool isGuaranteedToExecute(const Instruction *I, const Loop *L,
+                                  const DominatorTree *DT,
+                                  const LoopMemorySummary &Mem) {
+    SmallVector<BasicBlock *, 8> ExitBlocks;
+    L->getExitBlocks(ExitBlocks);
+    if (ExitBlocks.empty()) {
+        return false;
+    }
+    const BasicBlock *BB = I->getParent();
+    if (BB == L->getHeader()) {
+        for (auto &J : *BB) {
+            if (&J == I) {
+                return true;
             }
+            if (!isGuaranteedToTransferExecutionToSuccessor(&J)) {
+                return false;
             }
         }
     }
-
-    bool isAllocaInsideLoop = false;
-    if (isAlloca) {
-        if (const Instruction *addrInst = dyn_cast<Instruction>(loadAddr)) {
-            isAllocaInsideLoop = L->contains(addrInst->getParent());
+    if (Mem.mayStop() || !dominatesAllExits(I, L, DT)) {
+        return false;
+    }
+    SmallVector<BasicBlock *, 4> Latches;
+    L->getLoopLatches(Latches);
+    for (auto latch : Latches) {
+        if (!DT->dominates(BB, latch)) {
+            return false;
         }
     }
+    return true;
+}
 
-    if (isa<GlobalVariable>(loadAddr) && !hasStores) {
-        return true;
+// Calls with loop invariant arguments can be hoisted when the callee does
+// not touch memory, or only reads it and nothing in the loop writes. Unlike
+// the speculatable intrinsics makeLoopInvariant already handles, an ordinary
+// call may trap or not return even when it is readnone and nounwind, so it
+// must be one the loop was going to make anyway.
+bool canMoveCallOutOfLoop(const Loop *L, const CallInst *call,
+                          const DominatorTree *DT, LoopMemorySummary &Mem) {
+    if (isa<IntrinsicInst>(call) || call->isConvergent() ||
+        !call->doesNotThrow() || !L->hasLoopInvariantOperands(call)) {
+        return false;
     }
-    if (isAlloca && !hasStores && !isAllocaInsideLoop) {
-        return true;
+    if (!call->doesNotAccessMemory() &&
+        (!call->onlyReadsMemory() || Mem.mayWriteMemory())) {
+        return false;
     }
-    if (!hasAnyStores && L->isLoopInvariant(loadAddr) &&
-        dominatesAllExits(load, L, DT)) {
-        return true;
+    return isGuaranteedToExecute(call, L, DT, Mem);
+}
+
+// Blocks that stores sunk out of one loop go to, one per exit. An exit that
+// is also reached from outside the loop gets a new block on the loop's edges
+// into it, so the stores only run when leaving this loop. The blocks are made
+// when the first store is sunk and shared by every later store from the
+// loop, and the dominator tree takes all of the splits as one batch.
+class LoopExitBlocks {
+  public:
+    LoopExitBlocks(const Loop *L, DominatorTree &DT, LoopInfo &LI)
+        : L(L), DT(DT), LI(LI) {}
+
+    // Empty if the loop has no exits or one of them cannot take a store
+    ArrayRef<BasicBlock *> get() {
+        if (!Computed) {
+            compute();
+            Computed = true;
+        }
+        return Blocks;
     }
 
-    return false;
-}
+  private:
+    void compute() {
+        SmallVector<BasicBlock *, 8> ExitBlocks;
+        L->getUniqueExitBlocks(ExitBlocks);
+
+        DomTreeUpdater DTU(DT, DomTreeUpdater::UpdateStrategy::Lazy);
+        bool usable = true;
+        for (auto exitBlock : ExitBlocks) {
+            SmallSetVector<BasicBlock *, 4> inLoopPreds;
+            bool shared = false;
+            for (auto pred : predecessors(exitBlock)) {
+                if (L->contains(pred)) {
+                    inLoopPreds.insert(pred);
+                } else {
+                    shared = true;
+                }
+            }
 
-// Copy `store` on each exit edge (insert a new block between the
-// source and destination blocks of each exit edge and add a copy of
-// `store` to that block)
-void sinkStore(const Loop *L, StoreInst *store,
-               DominatorTreeBase<BasicBlock, false> *DT) {
-    //    Get all the exit edges of the loop
-    SmallVector<BasicBlock *, 8> ExitBlocks;
-    L->getExitBlocks(ExitBlocks);
+            BasicBlock *landing = exitBlock;
+            if (shared) {
+                landing = SplitBlockPredecessors(exitBlock,
+                                                 inLoopPreds.getArrayRef(),
+                                                 ".loopexit", &DTU, &LI);
+                if (landing) {
+                    LICMExitSplit++;
+                }
+            }
+            if (!landing || landing->getFirstInsertionPt() == landing->end()) {
+                usable = false;
+                break;
+            }
+            Blocks.push_back(landing);
+        }
+        DTU.flush();
+
+        if (!usable) {
+            Blocks.clear();
+        }
+    }
+
+    const Loop *L;
+    DominatorTree &DT;
+    LoopInfo &LI;
+    bool Computed = false;
+    SmallVector<BasicBlock *, 8> Blocks;
+};
+
+// Sink `store` out of the loop: the loop keeps the stored value in a register
+// and a copy of the store on each exit block writes the last value back.
+// Returns false, leaving the store in place, if it cannot be sunk.
+bool sinkStore(const Loop *L, StoreInst *store, DominatorTree *DT,
+               LoopMemorySummary &Mem, LoopExitBlocks &Exits) {
+    ArrayRef<BasicBlock *> ExitBlocks = Exits.get();
+    if (ExitBlocks.empty()) {
+        return false;
+    }
+
+    Value *storeAddr = store->getPointerOperand();
+    Value *storedValue = store->getValueOperand();
+    SSAUpdater SSA;
+    SSA.Initialize(storedValue->getType(), storeAddr->getName());
+
+    // On a path that leaves the loop without running the store, memory still
+    // holds what it held on entry. Only allocas that do not escape reach here
+    // without the store dominating every exit: they can be loaded in the
+    // preheader without trapping, and writing the value back is unobservable.
+    if (!dominatesAllExits(store, L, DT)) {
+        BasicBlock *preHeader = L->getLoopPreheader();
+        LoadInst *initial = new LoadInst(
+            storedValue->getType(), storeAddr,
+            storeAddr->getName() + ".promoted", false, store->getAlign(),
+            preHeader->getTerminator());
+        SSA.AddAvailableValue(preHeader, initial);
+    }
+    SSA.AddAvailableValue(store->getParent(), storedValue);
 
-    //   For each exit edge, create a new block and add a copy of
-    //   `store` to that block. Update the DT as well
     for (auto exitBlock : ExitBlocks) {
-        BasicBlock *newBlock = BasicBlock::Create(
-            exitBlock->getContext(), "", exitBlock->getParent(), exitBlock);
-        newBlock->moveAfter(exitBlock);
-        BranchInst::Create(exitBlock, newBlock);
-        Instruction *storeClone = store->clone();
-        storeClone->insertBefore(newBlock->getTerminator());
-        DT->addNewBlock(newBlock, exitBlock);
+        auto *storeClone = cast<StoreInst>(store->clone());
+        storeClone->setOperand(0, SSA.GetValueInMiddleOfBlock(exitBlock));
+        storeClone->insertBefore(&*exitBlock->getFirstInsertionPt());
     }
     // Once store is cloned to all exit blocks, remove the original store
+    Mem.removeStore(store);
     store->eraseFromParent();
+    return true;
 }
 
 void moveLoopInvariants(const Loop *L, const BasicBlock::iterator iter,
-                        DominatorTreeBase<BasicBlock, false> *DT) {
+                        DominatorTree *DT, LoopMemorySummary &Mem,
+                        LoopExitBlocks &Exits, unsigned &speculationBudget) {
     Instruction *I = &*iter;
     // Move the instructions
     bool madeLoopInvariant = false;
@@ -404,21 +905,34 @@ void moveLoopInvariants(const Loop *L, const BasicBlock::iterator iter,
     if (madeLoopInvariant) {
         LICMBasic++;
     } else if (auto *load = dyn_cast<LoadInst>(I)) {
-        if (canMoveLoadOutOfLoop(L, load, DT)) {
+        bool speculative = false;
+        if (canMoveLoadOutOfLoop(L, load, DT, Mem, speculative) &&
+            (!speculative || speculationBudget > 0)) {
             auto preHeader = L->getLoopPreheader();
             load->moveBefore(preHeader->getTerminator());
-            LICMLoadHoist++;
+            Mem.removeLoad(load);
+            if (speculative) {
+                speculationBudget--;
+                LICMSpeculated++;
+            } else {
+                LICMLoadHoist++;
+            }
+        }
+    } else if (auto *call = dyn_cast<CallInst>(I)) {
+        if (canMoveCallOutOfLoop(L, call, DT, Mem)) {
+            call->moveBefore(L->getLoopPreheader()->getTerminator());
+            LICMCallHoist++;
         }
     } else if (auto *store = dyn_cast<StoreInst>(I)) {
-        if (canMoveStoreOutOfLoop(L, store, DT)) {
-            // sinkStore(L, store, DT);
+        if (canMoveStoreOutOfLoop(L, store, DT, Mem) &&
+            sinkStore(L, store, DT, Mem, Exits)) {
             LICMStoreSink++;
         }
     }
 }
 
-void loopInvariantCodeMotion(const Loop *L,
-                             DominatorTreeBase<BasicBlock, false> *DT) {
+void loopInvariantCodeMotion(const Loop *L, DominatorTree *DT, LoopInfo *LI,
+                             AAResults &AA) {
     NumLoops++;
     const ArrayRef<BasicBlock *> blocks = L->getBlocks();
     const BasicBlock *preHeader = L->getLoopPreheader();
@@ -432,6 +946,12 @@ void loopInvariantCodeMotion(const Loop *L,
     uint num_stores = 0;
     uint num_loads = 0;
     uint num_calls = 0;
+    LoopMemorySummary Mem(
+        L, AA, preHeader->getParent()->getParent()->getDataLayout());
+    // Each speculated load adds work to the preheader on paths that did not
+    // need it
+    unsigned speculationBudget = SpeculationCap;
+    LoopExitBlocks Exits(L, *DT, *LI);
 
     for (auto basicBlock : blocks) {
         for (auto instIter = basicBlock->begin();
@@ -449,7 +969,8 @@ void loopInvariantCodeMotion(const Loop *L,
 
             auto copyIter = instIter;
             instIter++;
-            moveLoopInvariants(L, copyIter, DT);
+            moveLoopInvariants(L, copyIter, DT, Mem, Exits,
+                               speculationBudget);
         }
     }
     if (num_calls) {
@@ -466,54 +987,245 @@ void loopInvariantCodeMotion(const Loop *L,
     }
 }
 
-// make a loop which returns all the nested loops, recursively
-void workOnNestedLoops(const Loop *L,
-                       DominatorTreeBase<BasicBlock, false> *DT) {
+// Loop pass driver. Gives every loop in LI a preheader, then runs Body on the
+// loops innermost first. What an inner loop hoists lands in its preheader,
+// which is part of the loop around it, so the outer loop sees it on its own
+// turn. Dedicated exits are only formed for loops that sink a store (see
+// LoopExitBlocks). Both keep DT and LI up to date as they insert blocks, so
+// each is computed once per function.
+static void forEachLoopInnermostFirst(DominatorTree &DT, LoopInfo &LI,
+                                      function_ref<void(Loop *)> Body) {
+    // Inner loops come after the loops containing them in preorder
+    SmallVector<Loop *, 8> Loops = LI.getLoopsInPreorder();
+    for (auto *L : Loops) {
+        if (!L->getLoopPreheader() &&
+            InsertPreheaderForLoop(L, &DT, &LI, nullptr, false)) {
+            LICMPreheaderInserted++;
+        }
+    }
 
-    for (auto *subloop : L->getSubLoops()) {
-        workOnNestedLoops(subloop, DT);
+    for (auto It = Loops.rbegin(); It != Loops.rend(); It++) {
+        Body(*It);
     }
-    loopInvariantCodeMotion(L, DT);
 }
 
-static void LoopInvariantCodeMotion(Module *M) {
-    errs() << "Name " << M->getName() << "\n";
-    // iterate over all functions in the module
-    for (auto F = M->begin(); F != M->end(); F++) {
-        // Get loop info for this function
-        auto *loops = new LoopInfoBase<BasicBlock, Loop>();
-        auto *DT = new DominatorTreeBase<BasicBlock, false>();
-        auto *func = &*F;
-
-        // Check if func has a body
-        if (func->empty()) {
+// LICM followed by CSE on one function. Neither looks outside the function,
+// so functions can be optimized in any order or at the same time.
+static void optimizeFunction(Function &F, CSEAnalysisCache &CSEAnalyses) {
+    {
+        StatsScope Scope("licm", &F);
+        DominatorTree DT(F);
+        LoopInfo LI(DT);
+        LICMAliasAnalyses Analyses(F, DT);
+
+        forEachLoopInnermostFirst(DT, LI, [&](Loop *L) {
+            loopInvariantCodeMotion(L, &DT, &LI, Analyses.AA);
+            if (VerifyDomTree) {
+                DominatorTree Fresh(F);
+                if (DT.compare(Fresh)) {
+                    report_fatal_error("p3: dominator tree out of date after "
+                                       "LICM of loop at " +
+                                       L->getHeader()->getName());
+                }
+            }
+        });
+    }
+
+    StatsScope Scope("cse", &F);
+    CommonSubexpressionElimination(F, CSEAnalyses);
+}
+
+static StatsCounter InferredReadNone = {
+    "", "InferredReadNone", "functions found not to access memory"};
+static StatsCounter InferredReadOnly = {
+    "", "InferredReadOnly", "functions found to only read memory"};
+static StatsCounter InferredNoUnwind = {
+    "", "InferredNoUnwind", "functions found not to throw"};
+
+// What a function body may do to memory visible to its callers
+enum class MemoryEffect { None, Read, Write };
+
+// Accesses to the function's own allocas cannot be seen by its callers.
+// Calls into the same SCC are assumed to behave like the SCC as a whole.
+static MemoryEffect getMemoryEffect(const Instruction &I,
+                                    const SmallPtrSetImpl<Function *> &SCC) {
+    if (!I.mayReadOrWriteMemory()) {
+        return MemoryEffect::None;
+    }
+    if (auto *load = dyn_cast<LoadInst>(&I)) {
+        if (!load->isSimple()) {
+            return MemoryEffect::Write;
+        }
+        if (isa<AllocaInst>(getUnderlyingObject(load->getPointerOperand()))) {
+            return MemoryEffect::None;
+        }
+        return MemoryEffect::Read;
+    }
+    if (auto *store = dyn_cast<StoreInst>(&I)) {
+        if (store->isSimple() &&
+            isa<AllocaInst>(getUnderlyingObject(store->getPointerOperand()))) {
+            return MemoryEffect::None;
+        }
+        return MemoryEffect::Write;
+    }
+    if (auto *call = dyn_cast<CallBase>(&I)) {
+        if (SCC.count(call->getCalledFunction()) ||
+            call->doesNotAccessMemory()) {
+            return MemoryEffect::None;
+        }
+        if (call->onlyReadsMemory()) {
+            return MemoryEffect::Read;
+        }
+    }
+    return MemoryEffect::Write;
+}
+
+// Small bottom-up version of the FunctionAttrs pass: marks functions that do
+// not access memory, only read it, or cannot throw, so LICM can hoist calls
+// to them. Callees are visited before their callers, and the functions of a
+// recursive cycle are decided together.
+static void inferFunctionAttributes(Module &M) {
+    CallGraph CG(M);
+    for (auto It = scc_begin(&CG); !It.isAtEnd(); ++It) {
+        SmallPtrSet<Function *, 4> SCC;
+        bool Exact = true;
+        for (CallGraphNode *Node : *It) {
+            Function *F = Node->getFunction();
+            if (!F || F->isDeclaration() || !F->hasExactDefinition()) {
+                Exact = false;
+                break;
+            }
+            SCC.insert(F);
+        }
+        if (!Exact) {
             continue;
         }
 
-        DT->recalculate(*func);
-        loops->analyze(*DT);
+        MemoryEffect Effect = MemoryEffect::None;
+        bool MayThrow = false;
+        for (Function *F : SCC) {
+            for (auto &I : instructions(*F)) {
+                Effect = std::max(Effect, getMemoryEffect(I, SCC));
+                if (auto *call = dyn_cast<CallBase>(&I)) {
+                    MayThrow |= !SCC.count(call->getCalledFunction()) &&
+                                !call->doesNotThrow();
+                }
+                MayThrow |= isa<InvokeInst>(I) || isa<ResumeInst>(I) ||
+                            isa<CleanupReturnInst>(I) ||
+                            isa<CatchSwitchInst>(I);
+            }
+        }
 
-        // iterate over all loops in the function
-        for (auto L : *loops) {
-            workOnNestedLoops(L, DT);
+        for (Function *F : SCC) {
+            if (Effect == MemoryEffect::None && !F->doesNotAccessMemory()) {
+                F->removeFnAttr(Attribute::ReadOnly);
+                F->removeFnAttr(Attribute::WriteOnly);
+                F->removeFnAttr(Attribute::ArgMemOnly);
+                F->removeFnAttr(Attribute::InaccessibleMemOnly);
+                F->removeFnAttr(Attribute::InaccessibleMemOrArgMemOnly);
+                F->setDoesNotAccessMemory();
+                InferredReadNone++;
+            } else if (Effect == MemoryEffect::Read && !F->onlyReadsMemory() &&
+                       !F->hasFnAttribute(Attribute::WriteOnly)) {
+                F->setOnlyReadsMemory();
+                InferredReadOnly++;
+            }
+            if (!MayThrow && !F->doesNotThrow()) {
+                F->setDoesNotThrow();
+                InferredNoUnwind++;
+            }
+        }
+    }
+}
+
+static void LoopInvariantCodeMotion(Module *M) {
+    NamedRegionTimer T("licm", "Loop Invariant Code Motion", "p3", "p3 LICM",
+                       TimePassesIsEnabled);
+    errs() << "Name " << M->getName() << "\n";
+    // Attributes of one function decide what can be hoisted in another, so
+    // they are settled before the functions are split up
+    {
+        StatsScope Scope("attributes");
+        inferFunctionAttributes(*M);
+    }
+    StatsScope Scope("licm+cse");
+    if (Threads > 1) {
+        optimizeFunctionsInParallel(*M, Threads, [](Function &F) {
+            CSEAnalysisCache CSEAnalyses;
+            optimizeFunction(F, CSEAnalyses);
+        });
+    } else {
+        // iterate over all functions in the module
+        CSEAnalysisCache CSEAnalyses;
+        for (auto &F : *M) {
+            if (!F.isDeclaration()) {
+                optimizeFunction(F, CSEAnalyses);
+                renameInProgramOrder(F);
+            }
         }
     }
 
     printStats();
-    CommonSubexpressionElimination(M);
     printCSEStats();
 }
 
+// -lazy: function bodies are read from the bitcode one at a time, and each
+// goes through the early optimizations, LICM and CSE as soon as it is loaded.
+// Functions shrink as they are optimized, so the module never holds every
+// body in its unoptimized form at once. Attribute inference needs all bodies
+// together and is skipped, so only calls to functions already marked readnone
+// or readonly are hoisted.
+static void optimizeLazily(Module &M) {
+    legacy::FunctionPassManager Passes(&M);
+    if (Mem2Reg)
+        Passes.add(createPromoteMemoryToRegisterPass());
+    if (CSE)
+        Passes.add(createEarlyCSEPass());
+    Passes.doInitialization();
+
+    CSEAnalysisCache CSEAnalyses;
+    for (auto &F : M) {
+        if (Error E = F.materialize()) {
+            report_fatal_error(std::move(E));
+        }
+        if (F.isDeclaration()) {
+            continue;
+        }
+        if (Mem2Reg || CSE) {
+            StatsScope Scope("prepare", &F);
+            Passes.run(F);
+        }
+        if (!NoLICM) {
+            optimizeFunction(F, CSEAnalyses);
+            renameInProgramOrder(F);
+        }
+    }
+
+    Passes.doFinalization();
+    // Whatever the functions did not pull in, such as metadata they do not use
+    if (Error E = M.materializeAll()) {
+        report_fatal_error(std::move(E));
+    }
+
+    if (!NoLICM) {
+        printStats();
+        printCSEStats();
+    }
+}
+
 // CSE Pass
 
-static llvm::Statistic CSEDead = {"", "CSEDead", "CSE found dead instructions"};
-static llvm::Statistic CSEElim = {"", "CSEElim", "CSE redundant instructions"};
-static llvm::Statistic CSESimplify = {"", "CSESimplify",
-                                      "CSE simplified instructions"};
-static llvm::Statistic CSELdElim = {"", "CSELdElim", "CSE redundant loads"};
-static llvm::Statistic CSEStore2Load = {"", "CSEStore2Load",
-                                        "CSE forwarded store to load"};
-static llvm::Statistic CSEStElim = {"", "CSEStElim", "CSE redundant stores"};
+static StatsCounter CSEDead = {"", "CSEDead", "CSE found dead instructions"};
+static StatsCounter CSEElim = {"", "CSEElim", "CSE redundant instructions"};
+static StatsCounter CSESimplify = {"", "CSESimplify",
+                                   "CSE simplified instructions"};
+static StatsCounter CSELdElim = {"", "CSELdElim", "CSE redundant loads"};
+static StatsCounter CSEStore2Load = {"", "CSEStore2Load",
+                                     "CSE forwarded store to load"};
+static StatsCounter CSEStElim = {"", "CSEStElim", "CSE redundant stores"};
+static StatsCounter CSEDeadIterations = {
+    "", "CSEDeadIterations",
+    "CSE dead instructions found only after removing their users"};
 void printCSEStats() {
     errs() << "STATS:\n";
     errs() << "CSE Dead:\t" << CSEDead << "\n";
@@ -522,67 +1234,96 @@ void printCSEStats() {
     errs() << "CSE LdElim:\t" << CSELdElim << "\n";
     errs() << "CSE Store2Load:\t" << CSEStore2Load << "\n";
     errs() << "CSE StElim:\t" << CSEStElim << "\n";
+    errs() << "CSE Dead Iterations:\t" << CSEDeadIterations << "\n";
     errs() << "CSE Total:\t"
            << CSEDead + CSEElim + CSESimplify + CSELdElim + CSEStore2Load +
                   CSEStElim
            << "\n";
 }
 bool isDead(Instruction &I);
-void basicCSEPass(BasicBlock::iterator &inputIterator);
+void basicCSEPass(BasicBlock::iterator &inputIterator, DominatorTree &DT);
 void eliminateRedundantLoads(LoadInst *loadInst,
                              BasicBlock::iterator &inputIterator);
 void eliminateRedundantStoreCall(Instruction *storeCall,
                                  BasicBlock::iterator &originalIterator);
-static void CommonSubexpressionElimination(Module *M) {
-
-    // Iterate over all instructions in the module
-    for (auto funcIter = M->begin(); funcIter != M->end(); funcIter++) {
-        for (auto blockIter = funcIter->begin(); blockIter != funcIter->end();
-             blockIter++) {
-            for (auto instIter = blockIter->begin();
-                 instIter != blockIter->end();) {
-                Instruction *I = &*instIter;
-                auto tempIter = instIter;
-                // Dead code elimination
-                if (isDead(*I)) {
-                    instIter++;
-                    I->eraseFromParent();
-                    CSEDead++;
-                    continue;
-                }
 
-                // Simplify instructions
-                if (auto simplified =
-                        SimplifyInstruction(I, M->getDataLayout())) {
-                    instIter++;
-                    I->replaceAllUsesWith(simplified);
-                    I->eraseFromParent();
-                    CSESimplify++;
-                    continue;
-                }
+// Worklist dead code elimination. Every instruction is checked once; when one
+// is erased its operands go back on the worklist since they may have just
+// lost their last use, so whole dead chains disappear in a single run.
+static void eliminateDeadCode(Function &F) {
+    SetVector<Instruction *> worklist;
+    for (auto &I : instructions(F)) {
+        worklist.insert(&I);
+    }
 
-                // Optimization 1: Common Subexpression Elimination
-                auto copyIterator = instIter;
-                basicCSEPass(copyIterator);
+    while (!worklist.empty()) {
+        Instruction *I = worklist.pop_back_val();
+        if (!isDead(*I)) {
+            continue;
+        }
+        for (Value *operand : I->operands()) {
+            if (auto *opInst = dyn_cast<Instruction>(operand)) {
+                worklist.insert(opInst);
+            }
+        }
+        I->eraseFromParent();
+        CSEDead++;
+        CSEDeadIterations++;
+    }
+}
 
-                // Optimization 2: Eliminate Redundant Loads
-                if (I->getOpcode() == Instruction::Load) {
-                    auto copyIterator = instIter;
-                    LoadInst *loadInst = cast<LoadInst>(I);
-                    eliminateRedundantLoads(loadInst, copyIterator);
-                }
+static void CommonSubexpressionElimination(Function &F,
+                                           CSEAnalysisCache &Analyses) {
+    const DataLayout &DL = F.getParent()->getDataLayout();
+    DominatorTree &DT = Analyses.getDomTree(F);
 
-                // Optimization 3: Eliminate Redundant Stores
-                if (I->getOpcode() == Instruction::Store) {
-                    eliminateRedundantStoreCall(I, instIter);
-                }
+    // Iterate over all instructions in the function
+    for (auto blockIter = F.begin(); blockIter != F.end(); blockIter++) {
+        for (auto instIter = blockIter->begin();
+             instIter != blockIter->end();) {
+            Instruction *I = &*instIter;
+            auto tempIter = instIter;
+            // Dead code elimination
+            if (isDead(*I)) {
+                instIter++;
+                I->eraseFromParent();
+                CSEDead++;
+                continue;
+            }
 
-                if (instIter == tempIter) {
-                    instIter++;
-                }
+            // Simplify instructions
+            if (auto simplified = SimplifyInstruction(I, DL)) {
+                instIter++;
+                I->replaceAllUsesWith(simplified);
+                I->eraseFromParent();
+                CSESimplify++;
+                continue;
+            }
+
+            // Optimization 1: Common Subexpression Elimination
+            auto copyIterator = instIter;
+            basicCSEPass(copyIterator, DT);
+
+            // Optimization 2: Eliminate Redundant Loads
+            if (I->getOpcode() == Instruction::Load) {
+                auto copyIterator = instIter;
+                LoadInst *loadInst = cast<LoadInst>(I);
+                eliminateRedundantLoads(loadInst, copyIterator);
+            }
+
+            // Optimization 3: Eliminate Redundant Stores
+            if (I->getOpcode() == Instruction::Store) {
+                eliminateRedundantStoreCall(I, instIter);
+            }
+
+            if (instIter == tempIter) {
+                instIter++;
             }
         }
     }
+
+    // Remove what CSE, simplification and load forwarding left unused
+    eliminateDeadCode(F);
 }
 
 // Implementation
@@ -678,6 +1419,9 @@ bool isDead(Instruction &I) {
         case Instruction::ExtractValue:
         case Instruction::InsertValue:
             return true; // dead, but this is not enough
+        case Instruction::Load:
+            // Volatile and atomic loads must stay even when unused
+            return cast<LoadInst>(&I)->isSimple();
         default:
             // any other opcode fails
             return false;
@@ -699,20 +1443,12 @@ void removeCommonInstructionsIn(BasicBlock::iterator iterator, BasicBlock *bb,
     }
 }
 
-DomTreeNodeBase<BasicBlock> *getDomTree(Instruction *I) {
-    auto *bb = I->getParent();
-    auto *F = bb->getParent();
-    DominatorTreeBase<BasicBlock, false> *DT =
-        new DominatorTreeBase<BasicBlock, false>();
-    DT->recalculate(*F); // F is Function*. Use one DominatorTreeBase and
-                         // recalculate tree for each function you visit
-    DomTreeNodeBase<BasicBlock> *Node =
-        DT->getNode(bb); // get Node from some basic block*
-    return Node;
-}
-
-void removeCommonInstInDominatedBlocks(Instruction *I) {
-    auto *Node = getDomTree(I);
+void removeCommonInstInDominatedBlocks(Instruction *I, DominatorTree &DT) {
+    auto *Node = DT.getNode(I->getParent());
+    if (!Node) {
+        // Unreachable blocks are not in the tree
+        return;
+    }
     DomTreeNodeBase<BasicBlock>::iterator it, end;
     for (it = Node->begin(), end = Node->end(); it != end; it++) {
         BasicBlock *bb_next =
@@ -723,14 +1459,14 @@ void removeCommonInstInDominatedBlocks(Instruction *I) {
 }
 
 // Function which takes Instruction and returns a string
-void basicCSEPass(BasicBlock::iterator &inputIterator) {
+void basicCSEPass(BasicBlock::iterator &inputIterator, DominatorTree &DT) {
     auto *I = &*inputIterator;
     // Defensive checks, Early exit
     if (shouldCSEworkOnInstruction(I)) {
         // Remove common instructions in the same basic block
         removeCommonInstructionsIn(inputIterator, I->getParent(), I);
         // Remove common instructions in the same function, next block
-        removeCommonInstInDominatedBlocks(I);
+        removeCommonInstInDominatedBlocks(I, DT);
     }
 }
 
@@ -0,0 +1,82 @@
+; ModuleID = 'licm0'
+; CHECK-LABEL: source_filename = "licm0"
+source_filename = "licm0"
+
+; Stores are only sunk to the loop exit when that cannot add a store on a
+; path that had none. @h is written on every iteration, %a is a local that
+; does not escape; the conditional stores to @g and the escaping %b stay.
+
+@g = global i32 0
+@h = global i32 0
+
+declare void @use(i32*)
+declare void @may_throw() readnone
+
+; CHECK-LABEL: @licm0(i32 %n)
+define i32 @licm0(i32 %n) {
+; CHECK: entry:
+; CHECK: call void @use(i32* %b)
+; CHECK-NEXT: load i32, i32* %a
+entry:
+  %a = alloca i32, align 4
+  %b = alloca i32, align 4
+  store i32 0, i32* %a, align 4
+  store i32 0, i32* %b, align 4
+  call void @use(i32* %b)
+  br label %header
+
+; CHECK: header:
+; CHECK-NOT: store
+; CHECK: st:
+; CHECK-NEXT: store i32 %i, i32* @g
+; CHECK-NEXT: store i32 %i, i32* %b
+; CHECK-NEXT: br label %latch
+header:
+  %i = phi i32 [ 0, %entry ], [ %i1, %latch ]
+  store i32 %i, i32* @h, align 4
+  %odd = and i32 %i, 1
+  %c = icmp ne i32 %odd, 0
+  br i1 %c, label %st, label %latch
+
+st:
+  store i32 %i, i32* @g, align 4
+  store i32 %i, i32* %a, align 4
+  store i32 %i, i32* %b, align 4
+  br label %latch
+
+; CHECK: exit:
+; CHECK-DAG: store i32 %{{.*}}, i32* %a
+; CHECK-DAG: store i32 %i, i32* @h
+; CHECK: ret i32
+latch:
+  %i1 = add i32 %i, 1
+  %done = icmp eq i32 %i1, %n
+  br i1 %done, label %exit, label %header
+
+exit:
+  %r = load i32, i32* %a, align 4
+  ret i32 %r
+}
+
+; A caller may read @h after @may_throw unwinds out of the loop, so the
+; store stays even though it runs on every iteration.
+; CHECK-LABEL: @licm0_unwind(i32 %n)
+define void @licm0_unwind(i32 %n) {
+entry:
+  br label %header
+
+; CHECK: header:
+; CHECK-NEXT: phi
+; CHECK-NEXT: store i32 %i, i32* @h
+; CHECK-NEXT: call void @may_throw()
+header:
+  %i = phi i32 [ 0, %entry ], [ %i1, %header ]
+  store i32 %i, i32* @h, align 4
+  call void @may_throw()
+  %i1 = add i32 %i, 1
+  %done = icmp eq i32 %i1, %n
+  br i1 %done, label %exit, label %header
+
+exit:
+  ret void
+}
@@ -0,0 +1,84 @@
+; ModuleID = 'licm1'
+; CHECK-LABEL: source_filename = "licm1"
+source_filename = "licm1"
+
+; Calls are hoisted only if the loop was going to make them anyway. @div is
+; found to be readnone and nounwind, but it still traps when %z is 0, and
+; on the first iteration @maybe_exit ends the program before it is reached.
+
+declare void @exit(i32)
+
+define i32 @div(i32 %x) {
+  %r = sdiv i32 100, %x
+  ret i32 %r
+}
+
+define void @maybe_exit(i32 %i) {
+  %c = icmp eq i32 %i, 0
+  br i1 %c, label %e, label %r
+e:
+  call void @exit(i32 0)
+  unreachable
+r:
+  ret void
+}
+
+; CHECK-LABEL: @licm1(i32 %argc)
+define i32 @licm1(i32 %argc) {
+; CHECK: entry:
+; CHECK-NOT: call
+; CHECK: br label %header
+entry:
+  %z = sub i32 %argc, 1
+  br label %header
+
+header:
+  %i = phi i32 [ 0, %entry ], [ %i1, %J ]
+  %acc = phi i32 [ 0, %entry ], [ %acc1, %J ]
+  %c = icmp slt i32 %i, 5
+  br i1 %c, label %A, label %J
+
+A:
+  call void @maybe_exit(i32 %i)
+  br label %J
+
+; CHECK: J:
+; CHECK-NEXT: call i32 @div(i32 %z)
+J:
+  %r = call i32 @div(i32 %z)
+  %acc1 = add i32 %acc, %r
+  %i1 = add i32 %i, 1
+  %done = icmp eq i32 %i1, 10
+  br i1 %done, label %exit, label %header
+
+exit:
+  ret i32 %acc1
+}
+
+; Nothing before the call in the header can stop execution, so it runs on
+; the first iteration whenever the loop is entered and is hoisted.
+; CHECK-LABEL: @licm1_header(i32 %argc)
+define i32 @licm1_header(i32 %argc) {
+; CHECK: entry:
+; CHECK-NEXT: %z = sub i32 %argc, 1
+; CHECK-NEXT: call i32 @div(i32 %z)
+; CHECK-NEXT: br label %header
+entry:
+  %z = sub i32 %argc, 1
+  br label %header
+
+; CHECK: header:
+; CHECK-NOT: call
+; CHECK: ret i32
+header:
+  %i = phi i32 [ 0, %entry ], [ %i1, %header ]
+  %acc = phi i32 [ 0, %entry ], [ %acc1, %header ]
+  %r = call i32 @div(i32 %z)
+  %acc1 = add i32 %acc, %r
+  %i1 = add i32 %i, 1
+  %done = icmp eq i32 %i1, 10
+  br i1 %done, label %exit, label %header
+
+exit:
+  ret i32 %acc1
+}
@@ -0,0 +1,46 @@
+; ModuleID = 'licm2'
+; CHECK-LABEL: source_filename = "licm2"
+source_filename = "licm2"
+
+; The exit of the loop is also a target of the entry block, so it is not
+; dedicated to the loop. The load in the header runs before every way out
+; and is hoisted. The store to @g is sunk into a new block on the loop's
+; edge to the exit, so the path that skips the loop does not write @g.
+
+@g = global i32 0
+
+; CHECK-LABEL: @licm2(i32* noalias %p, i32 %n, i1 %skip)
+define i32 @licm2(i32* noalias %p, i32 %n, i1 %skip) {
+; CHECK: ph:
+; CHECK-NEXT: load i32, i32* %p
+; CHECK-NEXT: br label %header
+entry:
+  br i1 %skip, label %exit, label %ph
+
+ph:
+  br label %header
+
+; CHECK: header:
+; CHECK-NOT: load
+; CHECK-NOT: store
+; CHECK: br i1 %done, label %exit.loopexit, label %header
+header:
+  %i = phi i32 [ 0, %ph ], [ %i1, %header ]
+  %s = phi i32 [ 0, %ph ], [ %s1, %header ]
+  %v = load i32, i32* %p, align 4
+  %s1 = add i32 %s, %v
+  store i32 %s1, i32* @g, align 4
+  %i1 = add i32 %i, 1
+  %done = icmp eq i32 %i1, %n
+  br i1 %done, label %exit, label %header
+
+; CHECK: exit.loopexit:
+; CHECK-NEXT: store i32 %s1, i32* @g
+; CHECK-NEXT: br label %exit
+; CHECK: exit:
+; CHECK-NOT: store
+; CHECK: ret i32
+exit:
+  %r = phi i32 [ 0, %entry ], [ %s1, %header ]
+  ret i32 %r
+}
@@ -0,0 +1,55 @@
+; ModuleID = 'licm3'
+; CHECK-LABEL: source_filename = "licm3"
+source_filename = "licm3"
+
+; Loads that only run on odd iterations. Both addresses are known to be
+; dereferenceable, an element of @t and an argument marked so, but the
+; loads are only hoisted with -licm-speculate, and -licm-speculate-cap=1
+; hoists the first one only.
+
+@t = global [4 x i32] [i32 1, i32 2, i32 3, i32 4], align 4
+
+; CHECK-LABEL: @licm3(
+define i32 @licm3(i32* align 4 dereferenceable(4) %p, i32 %n) {
+; NOSPEC: entry:
+; NOSPEC-NEXT: br label %header
+; SPEC: entry:
+; SPEC-NEXT: load i32, i32* getelementptr inbounds ({{.*}} @t,
+; SPEC-NEXT: load i32, i32* %p
+; CAP: entry:
+; CAP-NEXT: load i32, i32* getelementptr inbounds ({{.*}} @t,
+; CAP-NEXT: br label %header
+entry:
+  br label %header
+
+header:
+  %i = phi i32 [ 0, %entry ], [ %i1, %latch ]
+  %s = phi i32 [ 0, %entry ], [ %s1, %latch ]
+  %odd = and i32 %i, 1
+  %c = icmp ne i32 %odd, 0
+  br i1 %c, label %cond, label %latch
+
+; NOSPEC: cond:
+; NOSPEC-NEXT: load i32, i32* getelementptr inbounds ({{.*}} @t,
+; NOSPEC-NEXT: load i32, i32* %p
+; SPEC: cond:
+; SPEC-NOT: load
+; SPEC: br label %latch
+; CAP: cond:
+; CAP-NEXT: load i32, i32* %p
+cond:
+  %x = load i32, i32* getelementptr inbounds ([4 x i32], [4 x i32]* @t, i64 0, i64 2), align 4
+  %y = load i32, i32* %p, align 4
+  %xy = add i32 %x, %y
+  br label %latch
+
+latch:
+  %v = phi i32 [ 0, %header ], [ %xy, %cond ]
+  %s1 = add i32 %s, %v
+  %i1 = add i32 %i, 1
+  %done = icmp eq i32 %i1, %n
+  br i1 %done, label %exit, label %header
+
+exit:
+  ret i32 %s1
+}
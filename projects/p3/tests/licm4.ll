@@ -0,0 +1,70 @@
+; ModuleID = 'licm4'
+; CHECK-LABEL: source_filename = "licm4"
+source_filename = "licm4"
+
+; Loads are hoisted past stores that alias analysis shows write somewhere
+; else: another global, a local alloca, or a float the TBAA tags keep apart
+; from the int that is loaded. A store through an i32 pointer from the
+; caller may write @g, so then the load stays.
+
+@g = global i32 0
+@h = global i32 0
+
+; CHECK-LABEL: @licm4(float* %f, i32 %n)
+define i32 @licm4(float* %f, i32 %n) {
+; CHECK: entry:
+; CHECK: load i32, i32* @g
+; CHECK-NEXT: br label %header
+entry:
+  %a = alloca i32, align 4
+  br label %header
+
+; CHECK: header:
+; CHECK-NOT: load i32, i32* @g
+; CHECK: br i1
+header:
+  %i = phi i32 [ 0, %entry ], [ %i1, %header ]
+  %s = phi i32 [ 0, %entry ], [ %s1, %header ]
+  %x = load i32, i32* @g, align 4, !tbaa !3
+  store i32 %i, i32* %a, align 4, !tbaa !3
+  store i32 %i, i32* @h, align 4, !tbaa !3
+  %fi = sitofp i32 %i to float
+  store float %fi, float* %f, align 4, !tbaa !4
+  %s1 = add i32 %s, %x
+  %i1 = add i32 %i, 1
+  %done = icmp eq i32 %i1, %n
+  br i1 %done, label %exit, label %header
+
+exit:
+  ret i32 %s1
+}
+
+; CHECK-LABEL: @licm4_mayalias(i32* %r, i32 %n)
+define i32 @licm4_mayalias(i32* %r, i32 %n) {
+; CHECK: entry:
+; CHECK-NEXT: br label %header
+entry:
+  br label %header
+
+; CHECK: header:
+; CHECK: load i32, i32* @g
+; CHECK: store i32 %i, i32* %r
+header:
+  %i = phi i32 [ 0, %entry ], [ %i1, %header ]
+  %s = phi i32 [ 0, %entry ], [ %s1, %header ]
+  %x = load i32, i32* @g, align 4, !tbaa !3
+  store i32 %i, i32* %r, align 4, !tbaa !3
+  %s1 = add i32 %s, %x
+  %i1 = add i32 %i, 1
+  %done = icmp eq i32 %i1, %n
+  br i1 %done, label %exit, label %header
+
+exit:
+  ret i32 %s1
+}
+
+!0 = !{!"tbaa root"}
+!1 = !{!"int", !0, i64 0}
+!2 = !{!"float", !0, i64 0}
+!3 = !{!1, !1, i64 0}
+!4 = !{!2, !2, i64 0}
@@ -0,0 +1,53 @@
+; ModuleID = 'licm5'
+; CHECK-LABEL: source_filename = "licm5"
+source_filename = "licm5"
+
+; Neither loop of the nest has a preheader: the outer header is entered
+; from two blocks and the inner one from a block that also branches
+; elsewhere. Both get one, and the invariant product computed in the inner
+; loop is hoisted into the inner preheader and from there, on the outer
+; loop's turn, into the outer preheader.
+
+; CHECK-LABEL: @licm5(i32 %a, i32 %b, i32 %n, i1 %c)
+define i32 @licm5(i32 %a, i32 %b, i32 %n, i1 %c) {
+entry:
+  br i1 %c, label %outer, label %other
+
+other:
+  br label %outer
+
+; CHECK: outer.preheader:
+; CHECK-NEXT: %m = mul i32 %a, %b
+; CHECK-NEXT: br label %outer
+; CHECK: outer:
+; CHECK-NOT: mul
+; CHECK: inner.preheader:
+; CHECK-NOT: mul
+; CHECK: inner:
+; CHECK-NOT: mul
+; CHECK: ret i32
+outer:
+  %i = phi i32 [ 0, %entry ], [ 0, %other ], [ %i1, %latch ]
+  %s = phi i32 [ 0, %entry ], [ 0, %other ], [ %s1, %latch ]
+  %odd = and i32 %i, 1
+  %t = icmp ne i32 %odd, 0
+  br i1 %t, label %inner, label %latch
+
+inner:
+  %j = phi i32 [ 0, %outer ], [ %j1, %inner ]
+  %u = phi i32 [ %s, %outer ], [ %u1, %inner ]
+  %m = mul i32 %a, %b
+  %u1 = add i32 %u, %m
+  %j1 = add i32 %j, 1
+  %jdone = icmp eq i32 %j1, %n
+  br i1 %jdone, label %latch, label %inner
+
+latch:
+  %s1 = phi i32 [ %s, %outer ], [ %u1, %inner ]
+  %i1 = add i32 %i, 1
+  %done = icmp eq i32 %i1, %n
+  br i1 %done, label %exit, label %outer
+
+exit:
+  ret i32 %s1
+}
@@ -4,85 +4,122 @@
 #include "llvm/IR/Function.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/BasicBlock.h"
-#include <set>
+#include "llvm/ADT/DenseSet.h"
+#include <vector>
 #include "llvm/IR/InstIterator.h"
 #include "worklist.h"
 
 using namespace llvm;
 
-typedef std::set<Value*> worklist_internal;
+/* Values waiting in the list are Items[Head..]; FIFO pops advance Head and
+   LIFO pops shrink Items. Queued holds exactly the waiting values, so a
+   value can be inserted again once it has been popped. */
+struct worklist_internal {
+  std::vector<Value*> Items;
+  size_t Head;
+  DenseSet<Value*> Queued;
+  worklist_order_t Order;
+
+  explicit worklist_internal(worklist_order_t Order) : Head(0), Order(Order) {}
+};
+
 /* Create an empty worklist */
 worklist_t worklist_create()
 {
-  worklist_internal *list = new std::set<Value*>();
+  return worklist_create_with_order(WORKLIST_FIFO);
+}
+
+worklist_t worklist_create_with_order(worklist_order_t order)
+{
+  worklist_internal *list = new worklist_internal(order);
   return (worklist_t) list;
 }
 
 void worklist_destroy(worklist_t w)
 {
-  worklist_internal *list = new worklist_internal();
+  worklist_internal *list = (worklist_internal*)w;
   delete list;
 }
 
 worklist_t worklist_for_function(LLVMValueRef F)
 {
   Function *Fun = unwrap<Function>(F);
-  worklist_internal *list = new worklist_internal();
-  
+  worklist_t list = worklist_create();
+
   for (inst_iterator I = inst_begin(Fun), E = inst_end(Fun); I != E; ++I)
-    list->insert(&*I);
-  
-  return (worklist_t) list;
+    worklist_insert(list, wrap(&*I));
+
+  return list;
 }
 
 worklist_t worklist_for_basicblock(LLVMBasicBlockRef BBRef)
 {
   BasicBlock *BB = unwrap(BBRef);
   BasicBlock::iterator I,E;
-  worklist_internal *list = new worklist_internal();
+  worklist_t list = worklist_create();
   for(I=BB->begin(),E=BB->end(); I!=E; I++)
     {
-      list->insert(&*I);
+      worklist_insert(list, wrap(&*I));
     }
-  return (worklist_t) list;
+  return list;
 }
 
 /* Insert a new value into worklist */
 void worklist_insert(worklist_t w, LLVMValueRef val)
 {
   worklist_internal *list = (worklist_internal*)w;
-  list->insert(unwrap(val));
+  Value *V = unwrap(val);
+  if (list->Queued.insert(V).second)
+    list->Items.push_back(V);
 }
 
 /* Check if empty */
 LLVMBool worklist_empty(worklist_t w)
 {
   worklist_internal *list = (worklist_internal*)w;
-  return (LLVMBool)list->empty();
+  return (LLVMBool)list->Queued.empty();
+}
+
+unsigned worklist_size(worklist_t w)
+{
+  worklist_internal *list = (worklist_internal*)w;
+  return list->Queued.size();
 }
 
 /* Get next data to pop */
 LLVMValueRef worklist_top(worklist_t w)
 {
   worklist_internal *list = (worklist_internal*)w;
-  worklist_internal::iterator i = list->begin();
-  if(i!=list->end())
-    return wrap(*i);
-  else
+  if (list->Queued.empty())
     return NULL;
+  if (list->Order == WORKLIST_LIFO)
+    return wrap(list->Items.back());
+  return wrap(list->Items[list->Head]);
 }
 
 /* Get and remove top from list */
 LLVMValueRef worklist_pop(worklist_t w)
 {
   worklist_internal *list = (worklist_internal*)w;
-  worklist_internal::iterator i =list->begin();
-  if(i!=list->end())
-    {
-      LLVMValueRef ret = wrap(*i);
-      list->erase(i);
-      return ret;
-    }
-  else
+  if (list->Queued.empty())
     return NULL;
+
+  Value *V;
+  if (list->Order == WORKLIST_LIFO) {
+    V = list->Items.back();
+    list->Items.pop_back();
+  } else {
+    V = list->Items[list->Head++];
+    // Reclaim the popped prefix once it is most of the vector, so a long
+    // lived queue neither grows without bound nor moves on every pop
+    if (list->Head == list->Items.size()) {
+      list->Items.clear();
+      list->Head = 0;
+    } else if (list->Head > 64 && list->Head * 2 > list->Items.size()) {
+      list->Items.erase(list->Items.begin(), list->Items.begin() + list->Head);
+      list->Head = 0;
+    }
+  }
+  list->Queued.erase(V);
+  return wrap(V);
 }
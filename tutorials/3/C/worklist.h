@@ -17,8 +17,17 @@ extern "C" {
 
 typedef void * worklist_t;
 
-/* Create an empty worklist */
+/* Order in which worklist_pop returns values: first in, first out, or last
+   in, first out. Either way a value already in the list is not added again,
+   and the order depends only on the order of insertion. */
+typedef enum {
+  WORKLIST_FIFO,
+  WORKLIST_LIFO
+} worklist_order_t;
+
+/* Create an empty worklist, FIFO unless an order is given */
 worklist_t worklist_create();
+worklist_t worklist_create_with_order(worklist_order_t order);
 
 void worklist_destroy(worklist_t);
 worklist_t worklist_for_function(LLVMValueRef Function);
@@ -30,6 +39,9 @@ void worklist_insert(worklist_t w, LLVMValueRef val);
 /* Check if empty */
 LLVMBool worklist_empty(worklist_t w);
 
+/* Number of values waiting in the list */
+unsigned worklist_size(worklist_t w);
+
 /* Get next data to pop */
 LLVMValueRef worklist_top(worklist_t w);
 
@@ -0,0 +1,115 @@
+#!/usr/bin/env python
+#
+# Tabulates the .stats.json records written by p2 and p3: one row per
+# benchmark, one column per configuration, summing the runs that share both.
+#
+#   jsonstats.py [-N config] [field] [file or directory ...]
+#
+# field is a module total such as Instructions or LICMBasic, or
+# "seconds:<pass>" for the time of one pass. Runs made with -time-report also
+# have "seconds" for the whole run and "phase:<phase>" for one phase of it.
+# -N divides every column by the named one. Without files the current
+# directory is searched. Each line of a file is a record, so records of many
+# runs may be concatenated into one file.
+
+from __future__ import print_function
+
+import json
+import os
+import sys
+
+
+def config_of(record):
+    # Options that are off are left out, the rest are listed by name
+    opts = []
+    for name in sorted(record.get('options', {})):
+        value = record['options'][name]
+        if value is True:
+            opts.append(name)
+        elif value is not False:
+            opts.append('%s=%s' % (name, value))
+    return ' '.join([record.get('tool', '?')] + opts)
+
+
+def benchmark_of(record):
+    return os.path.basename(record.get('input', '?')).split('.')[0]
+
+
+def value_of(record, field):
+    if field == 'seconds':
+        if 'phases' not in record:
+            return None
+        return sum(p['seconds'] for p in record['phases'])
+    if field.startswith('seconds:'):
+        name = field[len('seconds:'):]
+        return sum(p['seconds'] for p in record.get('passes', [])
+                   if p['name'] == name)
+    if field.startswith('phase:'):
+        name = field[len('phase:'):]
+        times = [p['seconds'] for p in record.get('phases', [])
+                 if p['name'] == name]
+        return sum(times) if times else None
+    return record.get('totals', {}).get(field)
+
+
+def find_records(paths):
+    for path in paths:
+        if os.path.isdir(path):
+            for root, dirs, files in os.walk(path):
+                for f in files:
+                    if f.endswith('.stats.json'):
+                        yield os.path.join(root, f)
+        else:
+            yield path
+
+
+def main(argv):
+    normalize = None
+    if len(argv) > 1 and argv[0] == '-N':
+        normalize = argv[1]
+        argv = argv[2:]
+    field = 'Instructions'
+    if argv:
+        field = argv[0]
+        argv = argv[1:]
+    if not argv:
+        argv = [os.getcwd()]
+
+    table = {}
+    configs = set()
+    for fname in find_records(argv):
+        with open(fname) as f:
+            for line in f:
+                if not line.strip():
+                    continue
+                record = json.loads(line)
+                value = value_of(record, field)
+                if value is None:
+                    continue
+                config = config_of(record)
+                configs.add(config)
+                row = table.setdefault(benchmark_of(record), {})
+                row[config] = row.get(config, 0) + value
+
+    configs = sorted(configs)
+    width = max([10] + [len(c) + 1 for c in configs])
+    print('Category'.ljust(20) + ''.join(c.rjust(width) for c in configs))
+    for bench in sorted(table):
+        row = table[bench]
+        s = bench.ljust(20, '.')
+        for c in configs:
+            if c not in row:
+                cell = '(missing)'
+            elif normalize is not None:
+                base = row.get(normalize)
+                cell = '%.3f' % (float(row[c]) / base) if base else 'x'
+            elif isinstance(row[c], float):
+                cell = '%.4f' % row[c]
+            else:
+                cell = str(row[c])
+            s += cell.rjust(width, '.')
+        print(s)
+
+
+if __name__ == '__main__':
+    main(sys.argv[1:])